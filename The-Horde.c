@@ -1,9 +1,11 @@
 #include <avr/io.h>
 #include <util/delay.h>
 #include <stdio.h>
+#include <string.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/pgmspace.h>
 #include <stdbool.h>
-#include <math.h>
 
 #include "lcd.h"
 #include "graphics.h"
@@ -12,120 +14,131 @@
 
 #include "usb_serial.h"
 
-//Function declarations
-void init_hardware(void);
-void init_adc(void);
-
-void intro_screen(void);
-void countdown(void);
-void border(void);
-void status_display(void);
-
-void ship_setup(void);
-void alien_setup(void);
-void missile_setup(void);
-void mothership_setup(void);
-void msMissile_setup(void);
-void turret_setup(void);
-void turret_calc(void);
-
-void process(void);
-void alien_attack(Sprite* alien);
-void alien_spawn(Sprite* alien);
-void mothership_attack(Sprite* mothership);
-void msMissile_attack(Sprite* msMissile);
-
-void collision_checker(void);
-bool collision_SnA(Sprite* alien);
-bool collision_MSnS(void);
-bool collision_MSnM(Sprite* missile);
-bool collision_MnA(Sprite* missile, Sprite* alien);
-bool collision_MsMnS(void);
-
-void game_end(void);
-
-void sprite_turn_to(Sprite* sprite, double dx, double dy);
-bool sprite_step(Sprite* sprite);
-bool sprite_show(Sprite* sprite);
-bool sprite_hide(Sprite* sprite);
-bool sprite_move_to(Sprite* sprite, double x, double y);
-void sprite_set_image(Sprite* sprite, char image[]);
-void sprite_turn(Sprite* sprite, double degrees);
-
-int get_game_time(void);
-double get_system_time(void);
+#include "The-Horde.h"
+
+//Host build: the game runs under host/bench.c, which owns the entry point
+#ifdef HOST_BUILD
+#include "host.h"
+#define main horde_main
+#endif
+
+//Phase markers and counters for the host benchmark; compiled out on the Teensy
+#ifndef BENCH_MARK
+#define BENCH_MARK(phase)
+#define BENCH_COUNT(counter)
+#define BENCH_WHEEL(event) false
+#endif
+
+//Integer trigonometry tables, in the units of The-Horde.h
+const int16_t sine_table[256] PROGMEM = {
+  0, 402, 804, 1205, 1606, 2006, 2404, 2801,
+  3196, 3590, 3981, 4370, 4756, 5139, 5520, 5897,
+  6270, 6639, 7005, 7366, 7723, 8076, 8423, 8765,
+  9102, 9434, 9760, 10080, 10394, 10702, 11003, 11297,
+  11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395,
+  13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+  15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986,
+  16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379,
+  16384, 16379, 16364, 16340, 16305, 16261, 16207, 16143,
+  16069, 15986, 15893, 15791, 15679, 15557, 15426, 15286,
+  15137, 14978, 14811, 14635, 14449, 14256, 14053, 13842,
+  13623, 13395, 13160, 12916, 12665, 12406, 12140, 11866,
+  11585, 11297, 11003, 10702, 10394, 10080, 9760, 9434,
+  9102, 8765, 8423, 8076, 7723, 7366, 7005, 6639,
+  6270, 5897, 5520, 5139, 4756, 4370, 3981, 3590,
+  3196, 2801, 2404, 2006, 1606, 1205, 804, 402,
+  0, -402, -804, -1205, -1606, -2006, -2404, -2801,
+  -3196, -3590, -3981, -4370, -4756, -5139, -5520, -5897,
+  -6270, -6639, -7005, -7366, -7723, -8076, -8423, -8765,
+  -9102, -9434, -9760, -10080, -10394, -10702, -11003, -11297,
+  -11585, -11866, -12140, -12406, -12665, -12916, -13160, -13395,
+  -13623, -13842, -14053, -14256, -14449, -14635, -14811, -14978,
+  -15137, -15286, -15426, -15557, -15679, -15791, -15893, -15986,
+  -16069, -16143, -16207, -16261, -16305, -16340, -16364, -16379,
+  -16384, -16379, -16364, -16340, -16305, -16261, -16207, -16143,
+  -16069, -15986, -15893, -15791, -15679, -15557, -15426, -15286,
+  -15137, -14978, -14811, -14635, -14449, -14256, -14053, -13842,
+  -13623, -13395, -13160, -12916, -12665, -12406, -12140, -11866,
+  -11585, -11297, -11003, -10702, -10394, -10080, -9760, -9434,
+  -9102, -8765, -8423, -8076, -7723, -7366, -7005, -6639,
+  -6270, -5897, -5520, -5139, -4756, -4370, -3981, -3590,
+  -3196, -2801, -2404, -2006, -1606, -1205, -804, -402,
+};
 
-int rand(void);
-void srand(unsigned int seed);
+  //atan(2^-i) in 65536ths of a turn, for the CORDIC steps in trig_atan2()
+#define CORDIC_STEPS 10
 
-void check_debugger(void);
-void ship_info(int x_pos, int y_pos, char* direction);
+const uint16_t cordic_atan[CORDIC_STEPS] PROGMEM = {8192, 4836, 2555, 1297, 651, 326, 163, 81, 41, 20};
 
-void draw_centred(unsigned char y, char* string);
-void send_line(char* string);
-void send_debug_string(char string[]);
 
 
 //Sprites
+  //Bitmaps live in flash and are read with pgm_read_byte(); one byte per
+  //row, MSB leftmost, at most 8 pixels wide
 #define SHIP_WIDTH 3
 #define SHIP_HEIGHT 3
 
-unsigned char ship_image[3] = {
+const unsigned char ship_image[3] PROGMEM = {
 0b01000000,
 0b10100000,
 0b11100000,
 };
 
-unsigned char ship_left[3] = {
+const unsigned char ship_left[3] PROGMEM = {
 0b01100000,
 0b10100000,
 0b01100000,
 };
 
-unsigned char ship_right[3] = {
+const unsigned char ship_right[3] PROGMEM = {
 0b11000000,
 0b10100000,
 0b11000000,
 };
 
-unsigned char ship_down[3] = {
+const unsigned char ship_down[3] PROGMEM = {
 0b11100000,
 0b10100000,
 0b01000000,
 };
 
-Sprite ship;
+Entity ship;
 
 
 #define ALIEN_WIDTH 3
 #define ALIEN_HEIGHT 3
-#define MAX_A 5
 
-unsigned char alien_image[3] = {
+const unsigned char alien_image[3] PROGMEM = {
 0b11100000,
 0b11100000,
 0b11100000,
 };
 
-Sprite alien[MAX_A];
+Entity alien[MAX_A];
+uint8_t alien_slot[MAX_A], alien_where[MAX_A];
+Pool alien_pool = {alien, alien_slot, alien_where, MAX_A, 0};
 
 
 #define MISSILE_WIDTH 2
 #define MISSILE_HEIGHT 2
+#ifndef MAX_M
 #define MAX_M 5
+#endif
 
-unsigned char missile_image[2] = {
+const unsigned char missile_image[2] PROGMEM = {
 0b11000000,
 0b11000000,
 };
 
-Sprite missile[MAX_M];
+Entity missile[MAX_M];
+uint8_t missile_slot[MAX_M], missile_where[MAX_M];
+Pool missile_pool = {missile, missile_slot, missile_where, MAX_M, 0};
 
 
 #define MOTHERSHIP_WIDTH 8
 #define MOTHERSHIP_HEIGHT 8
 
-unsigned char mothership_full[8] = {
+const unsigned char mothership_full[8] PROGMEM = {
 0b11111111,
 0b11000011,
 0b10100101,
@@ -136,7 +149,7 @@ unsigned char mothership_full[8] = {
 0b11111111,
 };
 
-unsigned char mothership_34[8] = {
+const unsigned char mothership_34[8] PROGMEM = {
 0b11111111,
 0b10000001,
 0b10100101,
@@ -147,7 +160,7 @@ unsigned char mothership_34[8] = {
 0b11111111,
 };
 
-unsigned char mothership_half[8] = {
+const unsigned char mothership_half[8] PROGMEM = {
 0b11111111,
 0b10000001,
 0b10000001,
@@ -158,7 +171,7 @@ unsigned char mothership_half[8] = {
 0b11111111,
 };
 
-unsigned char mothership_14[8] = {
+const unsigned char mothership_14[8] PROGMEM = {
 0b11111111,
 0b10000001,
 0b10000001,
@@ -169,7 +182,7 @@ unsigned char mothership_14[8] = {
 0b11111111,
 };
 
-unsigned char mothership_dead[8] = {
+const unsigned char mothership_dead[8] PROGMEM = {
 0b11101101,
 0b00000001,
 0b10000000,
@@ -180,63 +193,368 @@ unsigned char mothership_dead[8] = {
 0b01101101,
 };
 
-Sprite mothership;
+Entity mothership;
 
 
 #define msMISSILE_WIDTH 3
 #define msMISSILE_HEIGHT 1
 
-unsigned char msMissile_image[1] = {
+const unsigned char msMissile_image[1] PROGMEM = {
 0b10100000
 };
 
-Sprite msMissile;
+#ifndef MAX_MS
+#define MAX_MS 1
+#endif
+
+Entity msMissile[MAX_MS];
+uint8_t msMissile_slot[MAX_MS], msMissile_where[MAX_MS];
+Pool msMissile_pool = {msMissile, msMissile_slot, msMissile_where, MAX_MS, 0};
 
 
 #define TURRET_WIDTH 4
 #define TURRET_HEIGHT 1
 
-unsigned char turret_image[1] = {
+const unsigned char turret_image[1] PROGMEM = {
 0b11110000
 };
 
-Sprite turret;
+Entity turret;
+
+
+const Hitbox hitbox[TYPES] = {
+  {SHIP_WIDTH, SHIP_HEIGHT},
+  {ALIEN_WIDTH, ALIEN_HEIGHT},
+  {MISSILE_WIDTH + 1, MISSILE_HEIGHT + 1}, //Missiles hit one pixel beyond their image
+  {MOTHERSHIP_WIDTH, MOTHERSHIP_HEIGHT},
+  {msMISSILE_WIDTH, msMISSILE_HEIGHT},
+  {TURRET_WIDTH, TURRET_HEIGHT},
+};
+
+//Random streams
+  //One xorshift generator per entity class, so a change in how often one
+  //class rolls doesn't reshuffle the others.
+#define RNG_SPAWN 0
+#define RNG_ALIEN 1
+#define RNG_MOTHERSHIP 2
+#define RNG_STREAMS 3
+
+uint16_t rng_state[RNG_STREAMS];
+
+Input input;
+
+//Button events
+  //The joystick raises INT0/INT1 (UP, RIGHT) and PCINT0 (DOWN, LEFT) on every
+  //edge; port F has no pin-change interrupt, so SW2 is scanned from the
+  //Timer 0 overflow. Accepted edges are queued as the button's bit, plus
+  //INPUT_PRESS when it went down, so a tap shorter than a frame still counts.
+#define INPUT_QUEUE 16 //Power of two
+#define INPUT_PRESS 0x80
+#define INPUT_BUTTONS 5
+#define INPUT_DEBOUNCE 40 //Timer 1 counts (~5 ms) before a button may change again
+#define INPUT_SERIAL_MAX 64 //Serial bytes drained per frame at most
+
+volatile uint8_t input_queue[INPUT_QUEUE];
+volatile uint8_t input_head = 0;
+volatile uint8_t input_tail = 0;
+volatile uint8_t button_state = 0;              //Debounced levels
+volatile uint16_t button_edge[INPUT_BUTTONS];   //TCNT1 at the last accepted edge
+
+  //Serial keys that act as buttons, in BUTTON_ bit order
+const char input_keys[] PROGMEM = "wdsak";
+
+#define GRID_CELL 8   //Must be at least the alien hitbox size
+#define GRID_W ((LCD_X + GRID_CELL - 1) / GRID_CELL)
+#define GRID_H ((LCD_Y + GRID_CELL - 1) / GRID_CELL)
+#define GRID_NONE 0xFF
+
+uint8_t grid_head[GRID_W * GRID_H];
+uint8_t grid_next[MAX_A];
+
+  //Flow field. The playfield has no obstacles, so a cell's heading to the
+  //ship depends only on its offset from the ship's cell. The field is kept
+  //in flash as one quadrant of headings by offset (trig_atan2() of the cell
+  //offsets), mirrored for the other three. The ship moving only moves the
+  //field's origin; nothing is rebuilt.
+#define FLOW_W 11
+#define FLOW_H 6
+
+#if GRID_W > FLOW_W || GRID_H > FLOW_H
+#error "flow_heading is smaller than the grid"
+#endif
+
+const uint8_t flow_heading[FLOW_H][FLOW_W] PROGMEM = {
+  {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {64, 32, 19, 13, 10, 8, 7, 6, 5, 4, 4},
+  {64, 45, 32, 24, 19, 16, 13, 11, 10, 9, 8},
+  {64, 51, 40, 32, 26, 22, 19, 17, 15, 13, 12},
+  {64, 54, 45, 38, 32, 27, 24, 21, 19, 17, 16},
+  {64, 56, 48, 42, 37, 32, 28, 25, 23, 21, 19},
+};
 
+uint8_t flow_x = GRID_NONE;  //Ship's cell: the field's origin
+uint8_t flow_y = GRID_NONE;
 
 //Variables
 volatile int score = 0;
 volatile int lives = 6;
 volatile int timer = 0;
-volatile int min;
-volatile int alienCount;
 volatile int bossHealth;
-volatile int debugCounter = 0;
 int angle;
 
 int16_t adc_value = 0;
 
-bool game_over = false;
+  //Potentiometer sampling. The ADC converts continuously; ADC_vect averages
+  //2^ADC_OVERSAMPLE conversions into one reading, then low-pass filters the
+  //readings with weight 1/2^ADC_FILTER. Either can be set to 0 to disable it.
+#define ADC_OVERSAMPLE 4
+#define ADC_FILTER 2
+
+volatile uint16_t adc_sum = 0;
+volatile uint8_t adc_samples = 0;
+volatile uint16_t adc_state = 0;
+volatile uint16_t adc_filtered = 0;
+
+//Scenes
+  //main() runs a single loop for the life of the device. Each pass waits for
+  //the next tick and gives the current scene one time slice; a scene never
+  //blocks, it keeps its progress in scene_stage and picks the next scene
+  //itself. Telemetry drains on every pass, whatever the scene.
+#define COUNTDOWN_STEP_MS 300
+#define DEBUGGER_HOLD_MS 3000
+
+uint8_t scene = SCENE_DEBUGGER;
+bool scene_entered = false;  //Set once the scene has drawn its screen
+uint8_t scene_stage = 0;     //Progress within the scene
+bool scene_pressed = false;  //A button is down, waiting for its release
+uint32_t scene_since;        //clock_ticks() when the scene (or stage) began
+
+  //Time from the game over button release to the first frame of the next
+  //game, logged once that frame is out
+uint32_t restart_since;
+bool restart_pending = false;
+uint16_t restart_ms = 0;
+
 bool attack[MAX_A] = {false};
-bool updateDirection[MAX_M] = {false};
 bool usb_connected = false;
 bool mothershipActive = false;
-bool gametime = false;
+volatile bool gametime = false;
 bool mothershipAttack;
 
 char * direction = "Up";
 
   //Overflow count
-volatile unsigned long ovf_count;
-volatile unsigned long overflow;
-
-  //Attack information
-double dx;
-double dy;
-double dist;
+  //Timer 1 overflows since power on: the high half of clock_ticks()
+volatile uint16_t clock_high = 0;
+
+  //The game clock is the system clock less the time spent paused;
+  //gametime is set while it runs
+uint32_t game_clock_base = 0;
+uint32_t game_clock_stop = 0;
+
+  //Dirty regions: the column span of each 8-row LCD bank to flush this frame,
+  //and the span drawn last frame (whose pixels may now need erasing)
+#define LCD_BANKS (LCD_Y / 8)
+#define SPAN_EMPTY 0xFF
+
+unsigned char dirty_first[LCD_BANKS], dirty_last[LCD_BANKS];
+unsigned char drawn_first[LCD_BANKS], drawn_last[LCD_BANKS];
+
+  //LCD pump. With LCD_ASYNC, dirty_flush() copies the frame's spans into
+  //lcd_front and returns; the Timer 0 compare A interrupt sends them a few
+  //bytes at a time while the next frame is drawn into screen_buffer. The LCD
+  //is bit-banged on GPIO pins (the SPI clock pin carries the joystick), so a
+  //timer paces the pump rather than the SPI interrupt.
+#define LCD_PUMP_BYTES 8   //Bytes sent per interrupt
+#define LCD_PUMP_PERIOD 4  //Timer 0 counts (128 us) between interrupts
+
+#if LCD_ASYNC
+unsigned char lcd_front[LCD_BUFFER_SIZE];
+#endif
+unsigned char pump_first[LCD_BANKS], pump_last[LCD_BANKS]; //Spans in lcd_front
+volatile uint8_t pump_bank = LCD_BANKS; //Bank being sent, LCD_BANKS when idle
+uint8_t pump_x;                         //Next column of pump_bank
+
+  //HUD cache. Glyph tiles are captured from the library font once. The HUD
+  //row (font rows 0-7, shown at y = 1) is kept in hud_buffer as a row of
+  //glyph slots, and only slots whose glyph changed are blitted into it.
+#define HUD_Y 1
+#define HUD_GLYPHS "0123456789:LST "
+#define HUD_COLON 10
+#define HUD_L 11
+#define HUD_S 12
+#define HUD_T 13
+#define HUD_BLANK 14
+
+#define HUD_SLOTS 16
+#define HUD_LIVES 2  //One digit
+#define HUD_SCORE 5  //Four digits, left-aligned
+#define HUD_MIN 11   //Two digits, zero-padded
+#define HUD_SEC 14   //Two digits, zero-padded
+#define HUD_DIGITS 4 //Widest number
+
+const char hud_glyphs[] PROGMEM = HUD_GLYPHS;
+const unsigned char hud_x[HUD_SLOTS] PROGMEM = {1, 6, 10, 20, 25, 29, 34, 39, 44, 49, 54, 58, 63, 69, 74, 79};
+unsigned char hud_text[HUD_SLOTS] = {
+  HUD_L, HUD_COLON, HUD_BLANK,
+  HUD_S, HUD_COLON, HUD_BLANK, HUD_BLANK, HUD_BLANK, HUD_BLANK,
+  HUD_T, HUD_COLON, 0, 0, HUD_COLON, 0, 0
+};
+unsigned char hud_shown[HUD_SLOTS];
+unsigned char hud_tile[sizeof(HUD_GLYPHS) - 1][5];
+unsigned char hud_buffer[LCD_X];
+
+  //HUD values last converted. The clock is only split into minutes and
+  //seconds once hud_next_ms is reached; hud_clock() is scheduled for the
+  //first frame after it.
+int hud_lives, hud_score;
+uint32_t hud_next_ms;
+
+  //Debug log ring. Producers (ISRs, or the main loop with interrupts masked
+  //for the few instructions of a push) advance log_head; only log_drain()
+  //advances log_tail, so draining never blocks a producer.
+#define LOG_SIZE 16            //Power of two
+#define LOG_BYTES_PER_FRAME 64 //One USB packet
+
+LogRecord log_ring[LOG_SIZE];
+volatile uint8_t log_head = 0;
+volatile uint8_t log_tail = 0;
+volatile uint8_t log_dropped = 0;
+
+char log_line[80];
+uint8_t log_length = 0;
+uint8_t log_sent = 0;
 
 //Timer information
-#define FREQUENCY 8000000.0
-#define PRESCALER 1024.0
+  //Simulation tick from Timer 1 compare match A. Timer 1 keeps running free
+  //for the game clock, so the ISR moves OCR1A on by one period each tick.
+  //A period of 7812.5 / TICK_HZ timer counts is split into a whole part and
+  //a remainder carried in 1/TICK_DIV steps, so the rate doesn't drift.
+#define TICK_HZ 20
+#define TICK_DIV (2 * TICK_HZ)
+#define TICK_WHOLE (15625 / TICK_DIV)
+#define TICK_REM (15625 % TICK_DIV)
+
+volatile uint8_t ticks_pending = 0;
+uint8_t tick_carry = 0;
+volatile uint16_t frame_overruns = 0;
+
+//Timer wheel
+  //Game events are scheduled a whole number of frames ahead, so a frame only
+  //visits the events that are due on it. Level 0 has a slot for each of the
+  //next WHEEL_SLOTS frames. Level 1 has a slot for each of the next
+  //WHEEL_SLOTS blocks of WHEEL_SLOTS frames, and a block's events move down
+  //to level 0 as it begins. Each event has a fixed id, so it is pending at
+  //most once; scheduling it again moves it. The geometry and event ids are
+  //in The-Horde.h.
+
+  //Mean frames between attacks and shots (they were 1 in n chances per
+  //frame), and between ship position logs
+#define ALIEN_ATTACK_FRAMES 30
+#define MOTHERSHIP_ATTACK_FRAMES 50
+#define MS_MISSILE_FRAMES 10
+#define SHIP_INFO_FRAMES (TICK_HZ / 2)
+
+uint16_t wheel_now = 0;               //Frames since the game started, wrapping
+uint8_t wheel_head[2 * WHEEL_SLOTS];  //Level 0 slots, then level 1
+uint8_t wheel_next[WHEEL_EVENTS];
+uint8_t wheel_slot[WHEEL_EVENTS];     //Slot holding the event, or WHEEL_NONE
+uint16_t wheel_due[WHEEL_EVENTS];
+
+//Stack instrumentation
+  //Before main() runs, the SRAM between the end of .bss and the top of the
+  //stack is painted with STACK_CANARY; how much paint is left shows the
+  //deepest the stack has ever reached. STACK_PROBE(site) records the depth
+  //inside a function (its own frame included, its callees' not), so the
+  //report can name the deepest paths. Set STACK_CHECK to 0 to drop both.
+#define STACK_CANARY 0xC5
+#define STACK_REPORT_FRAMES (5 * TICK_HZ)
+
+#if STACK_CHECK
+#define STACK_PROBE(site) do { \
+    uint16_t depth_ = RAMEND - SP; \
+    if (depth_ > stack_deepest[site]) stack_deepest[site] = depth_; \
+  } while (0)
+#else
+#define STACK_PROBE(site)
+#endif
+
+const char stack_name_main[] PROGMEM = "main loop";
+const char stack_name_process[] PROGMEM = "process";
+const char stack_name_collision[] PROGMEM = "collision_checker";
+const char stack_name_status[] PROGMEM = "status_display";
+const char stack_name_log[] PROGMEM = "log_format";
+const char stack_name_isr[] PROGMEM = "ISRs";
+const char* const stack_name[STACK_SITES] PROGMEM = {
+  stack_name_main, stack_name_process, stack_name_collision,
+  stack_name_status, stack_name_log, stack_name_isr
+};
+
+volatile uint16_t stack_deepest[STACK_SITES];
+uint16_t stack_reported[STACK_SITES];
+uint8_t stack_frames = 0;
+
+#if STACK_CHECK && !defined(HOST_BUILD)
+extern uint8_t _end;     //End of .bss, where the heap would start
+extern uint8_t __stack;  //Top of SRAM
+
+  //Runs from .init1, before the C runtime sets anything up: no stack, no
+  //zero register, so it's written in assembly
+void stack_paint(void) __attribute__((naked, used, section(".init1")));
+void stack_paint(void){
+  __asm volatile(
+    "    ldi r30, lo8(_end)\n"
+    "    ldi r31, hi8(_end)\n"
+    "    ldi r24, %0\n"
+    "    ldi r25, hi8(__stack)\n"
+    "    rjmp 2f\n"
+    "1:  st Z+, r24\n"
+    "2:  cpi r30, lo8(__stack)\n"
+    "    cpc r31, r25\n"
+    "    brlo 1b\n"
+    "    breq 1b\n"
+    :: "M" (STACK_CANARY)
+  );
+}
+#endif
+
+//Latency instrumentation
+  //With LATENCY_CHECK set, the first button press since the last frame is
+  //timestamped by the ISR that sees it (a serial key when the frame reads
+  //it), carried by the frame that samples it, and timed again once that
+  //frame has reached the LCD (dirty_flush(), or the pump it starts). The
+  //input-to-photon times are binned in LATENCY_BIN_MS steps and the
+  //non-empty bins are logged, one per frame, every LATENCY_REPORT_FRAMES.
+#define LATENCY_REPORT_FRAMES (5 * TICK_HZ)
+
+volatile uint32_t latency_input;      //clock_ticks() at the first unsampled press
+volatile bool latency_armed = false;  //latency_input is waiting for a frame
+uint32_t latency_frame;               //The input the frame being drawn took
+bool latency_carried = false;
+uint16_t latency_hist[LATENCY_BINS];
+uint8_t latency_frames = 0;
+uint8_t latency_next = LATENCY_BINS;  //Next bin to log, LATENCY_BINS when idle
+
+//Profiler
+  //With PROFILE set, PROFILE_BEGIN(zone) and PROFILE_END(zone) time a part of
+  //the frame on Timer 3, free-running at F_CPU / 8 (one count, 8 cycles, is
+  //1 us). Each zone keeps its min, max and total, and every
+  //PROFILE_REPORT_FRAMES they go out as '%' lines that the host bench
+  //decodes into a table (horde-bench profile).
+#define PROFILE_REPORT_FRAMES (5 * TICK_HZ)
+
+#if PROFILE
+#define PROFILE_BEGIN(zone) (profile_start[zone] = TCNT3)
+#define PROFILE_END(zone) profile_add(zone, TCNT3 - profile_start[zone])
+#else
+#define PROFILE_BEGIN(zone)
+#define PROFILE_END(zone)
+#endif
+
+uint16_t profile_start[PROFILE_ZONES];
+Profile profile[PROFILE_ZONES];
+Profile profile_sent[PROFILE_ZONES]; //The last report, read as its lines drain
+uint8_t profile_frames = 0;
 
 //Main
 int main(void){
@@ -244,30 +562,115 @@ int main(void){
   //Setting the clock speed
   set_clock_speed(CPU_8MHz);
 
+  //Hardware and the HUD tiles are set up once; a restart only resets the game
   init_hardware();
+  hud_init();
 
-  if (!usb_connected){
-    check_debugger();
+  while (true){
+    scene_step();
+  }
+}
+
+void scene_step(void){
+  STACK_PROBE(STACK_MAIN);
+  tick_wait();
+
+  switch (scene){
+    case SCENE_DEBUGGER:
+      check_debugger();
+      break;
+
+    case SCENE_INTRO:
+      intro_screen();
+      break;
+
+    case SCENE_COUNTDOWN:
+      countdown();
+      break;
+
+    case SCENE_PLAY:
+      input_sample();
+      process();
+      stack_report();
+      latency_report();
+      profile_report();
+
+      if (restart_pending){
+        restart_pending = false;
+        restart_ms = clock_ms(clock_ticks() - restart_since);
+        log_push(LOG_RESTART, 0, restart_ms, 0);
+      }
+      break;
+
+    case SCENE_GAME_OVER:
+      game_over_screen();
+      break;
+  }
+
+  log_drain();
+}
+
+void scene_set(uint8_t next){
+  scene = next;
+  scene_entered = false;
+  scene_stage = 0;
+  scene_pressed = false;
+  scene_since = clock_ticks();
+}
+
+  //True on the scene's first slice, when it should draw its screen
+bool scene_enter(void){
+  if (scene_entered){
+    return false;
+  }
+  scene_entered = true;
+  return true;
+}
+
+uint16_t scene_ms(void){
+  return clock_ms(clock_ticks() - scene_since);
+}
+
+  //True on the slice where a button that was pressed is let go
+bool scene_button(void){
+  bool down = ((PINF>>5) & 0b1) | ((PINF>>6) & 0b1);
+  if (down){
+    scene_pressed = true;
+    return false;
   }
 
-  intro_screen();
-  countdown();
+  bool released = scene_pressed;
+  scene_pressed = false;
+  return released;
+}
+
+  //Resets everything a game changes, without touching the hardware
+void game_start(uint16_t seed){
+  lives = 6;
+  score = 0;
 
-  srand(TCNT1);
+  input_seed(seed);
   adc_value = 0;
+  wheel_reset();
 
   ship_setup();
   alien_setup();
   missile_setup();
+  msMissile_setup();
 
-  ovf_count = 0;
-  min = 0;
+  game_clock_reset();
   mothershipActive = false;
 
-  while (!game_over){
-    process();
-    _delay_ms(50);
-  }
+  mothership_idle();
+  wheel_schedule(WHEEL_MS_MISSILE, rng_delay(RNG_MOTHERSHIP, MS_MISSILE_FRAMES));
+  wheel_schedule(WHEEL_SHIP_INFO, SHIP_INFO_FRAMES);
+  wheel_schedule(WHEEL_CLOCK, 1);
+
+  //The countdown left its own frame on the LCD
+  dirty_all();
+
+  //Ticks that fired during the intro aren't overruns
+  ticks_pending = 0;
 }
 
 void init_hardware(void) {
@@ -292,14 +695,31 @@ void init_hardware(void) {
   TCCR1B |= (1<<CS10);
   TCCR1B &= ~((1<<CS11));
 
-    //Set prescaler (T2) = 1024
+    //Set prescaler (T0) = 256, overflowing every 8 ms to scan port F
   TCCR0B |= (1<<CS02);
-  TCCR0B |= (1<<CS00);
   TCCR0B &= ~((1<<CS01));
+  TCCR0B &= ~((1<<CS00));
 
     //Enabling overflow interrupts
   TIMSK1 |= (1 << TOIE1); // Timer 1
   TIMSK0 |= (1 << TOIE1); // Timer 0
+
+#if PROFILE
+    //Timer 3 free-running at /8 for the profiler
+  TCCR3A = 0;
+  TCCR3B = (1<<CS31);
+#endif
+
+    //Joystick edges: INT0/INT1 on any change, PCINT7/PCINT1 on port B
+  EICRA |= (1<<ISC10) | (1<<ISC00);
+  EIMSK |= (1<<INT1) | (1<<INT0);
+  PCMSK0 |= (1<<PCINT7) | (1<<PCINT1);
+  PCICR |= (1<<PCIE0);
+
+    //Simulation tick on compare match A
+  OCR1A = TCNT1 + TICK_WHOLE;
+  TIMSK1 |= (1 << OCIE1A);
+  set_sleep_mode(SLEEP_MODE_IDLE);
   sei();
 
   //Initialise the USB Serial connection
@@ -319,52 +739,63 @@ void init_adc(void){
   ADCSRA |= 0b1 << 1;
   ADCSRA |= 0b1 << 2;
   ADCSRA |= 0b1 << 7;
-}
 
-void intro_screen(void){
-  clear_screen();
+  //Free running (ADCSRB trigger source 0) with the conversion interrupt
+  ADCSRB = 0;
+  ADCSRA |= 0b1 << 5; //ADATE
+  ADCSRA |= 0b1 << 3; //ADIE
+  ADCSRA |= 0b1 << 6; //Start the first conversion
+}
 
-  //Screen height and width
-  int h = LCD_Y;
+uint16_t adc_read(void){
+  //16-bit read of a value ADC_vect writes
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t value = adc_filtered;
+  SREG = sreg;
+  return value;
+}
 
-  draw_string(10, h / 2 - 24, "Alien Advance");
-  draw_string(14, h / 2 - 12, "Mary Millar");
-  draw_string(20, h / 2 - 4, "n9698337");
-  draw_string(7, h / 2 + 8, "Press a button");
-  draw_string(7, h / 2 + 16, "to continue...");
+void intro_screen(void){
+  if (scene_enter()){
+    clear_screen();
 
-  show_screen();
+    //Screen height and width
+    int h = LCD_Y;
 
-  while (! (((PINF>>5) & 0b1) | ((PINF>>6) & 0b1)));
+    draw_string_P(10, h / 2 - 24, PSTR("Alien Advance"));
+    draw_string_P(14, h / 2 - 12, PSTR("Mary Millar"));
+    draw_string_P(20, h / 2 - 4, PSTR("n9698337"));
+    draw_string_P(7, h / 2 + 8, PSTR("Press a button"));
+    draw_string_P(7, h / 2 + 16, PSTR("to continue..."));
 
-  if ((((PINF>>5) & 0b1) | ((PINF>>6) & 0b1))){
-    while ((PINF>>5) & 0b1);
-    while ((PINF>>6) & 0b1);
+    screen_show();
   }
 
-  clear_screen();
+  if (scene_button()){
+    clear_screen();
+    scene_set(SCENE_COUNTDOWN);
+  }
 }
 
+  //Shows 3, 2, 1 for COUNTDOWN_STEP_MS each, then starts the game
 void countdown(void){
-  int w = LCD_X, h = LCD_Y;
-  draw_string(w / 2 - 5, h / 2 - 5, "3");
-  show_screen();
-
-  _delay_ms(300);
-
-  clear_screen();
-  draw_string(w / 2 - 5, h / 2 - 5, "2");
-  show_screen();
-
-  _delay_ms(300);
+  uint8_t step = scene_ms() / COUNTDOWN_STEP_MS;
 
-  clear_screen();
-  draw_string(w / 2 - 5, h / 2 - 5, "1");
-  show_screen();
-
-  _delay_ms(300);
+  if (step >= 3){
+    clear_screen();
+    game_start(TCNT1);
+    scene_set(SCENE_PLAY);
+    return;
+  }
 
-  clear_screen();
+  if (scene_enter() || step != scene_stage){
+    int w = LCD_X, h = LCD_Y;
+    clear_screen();
+    draw_char(w / 2 - 5, h / 2 - 5, '3' - step);
+    screen_show();
+    scene_stage = step;
+  }
 }
 
 void border(void){
@@ -375,58 +806,102 @@ void border(void){
   draw_line(1, h - 1, w - 1 , h - 1);
   draw_line(1, 10, 1, h - 1);
   draw_line(w - 1, 10, w - 1, h - 1);
-
-  show_screen();
 }
 
 void status_display(void){
-  char life_count[5];
-  char timer_count[20];
-  char score_count[5];
-  char minutes[5];
+  STACK_PROBE(STACK_STATUS);
 
-  draw_string(1, 1, "L:");
-  sprintf(life_count, "%d", lives);
-  draw_string(10, 1, life_count);
+  //Values are only converted to digits when they change
+  if (lives != hud_lives){
+    hud_number(HUD_LIVES, 1, lives, false);
+    hud_lives = lives;
+  }
+  if (score != hud_score){
+    hud_number(HUD_SCORE, 4, score, false);
+    hud_score = score;
+  }
 
-  draw_string(20, 1, "S:");
-  sprintf(score_count, "%d", score);
-  draw_string(29, 1, score_count);
+  //Blit the changed slots, and any slot a redrawn neighbour overlapped
+  unsigned char covered = 0;
+  for (uint8_t i = 0; i < HUD_SLOTS; i++){
+    unsigned char x = pgm_read_byte(&hud_x[i]);
+    if (hud_text[i] != hud_shown[i] || x < covered){
+      memcpy(hud_buffer + x, hud_tile[hud_text[i]], 5);
+      hud_shown[i] = hud_text[i];
+      covered = x + 5;
+      dirty_mark(x, HUD_Y, 5, 8);
+    }
+  }
 
-  draw_string(42, 1, "T:");
-  sprintf(timer_count, "%d", get_game_time());
-  draw_string(54, 1 , "0");
-  sprintf(minutes, "%d", min);
-  draw_string(59, 1, minutes);
-  draw_string(64, 1, ":0");
+  //The frame was cleared; put rows 1-8 back from the cache
+  for (uint8_t x = 0; x < LCD_X; x++){
+    screen_buffer[x] = (screen_buffer[x] & 0x01) | (hud_buffer[x] << 1);
+    screen_buffer[LCD_X + x] = (screen_buffer[LCD_X + x] & 0xFE) | (hud_buffer[x] >> 7);
+  }
+}
 
-  if (get_game_time() < 10){
-    draw_string(75, 1, timer_count);
+  //Captures the digit and label tiles by drawing each glyph into the
+  //(still unused) screen buffer, and marks every slot for redrawing
+void hud_init(void){
+  clear_screen();
+  for (uint8_t g = 0; g < sizeof(HUD_GLYPHS) - 1; g++){
+    draw_char(0, 0, pgm_read_byte(&hud_glyphs[g]));
+    memcpy(hud_tile[g], screen_buffer, 5);
   }
+  clear_screen();
 
+  memset(hud_buffer, 0, sizeof(hud_buffer));
+  memset(hud_shown, 0xFF, sizeof(hud_shown));
+  hud_lives = hud_score = -1;
+  hud_next_ms = 0;
+}
+
+  //Integer conversion into width slots: left-aligned like "%d", or
+  //zero-padded when pad is set. Digits beyond width are dropped.
+void hud_number(uint8_t slot, uint8_t width, int value, bool pad){
+  unsigned char digits[HUD_DIGITS];
+  uint8_t n = 0;
+
+  do {
+    digits[n++] = value % 10;
+    value /= 10;
+  } while (value > 0 && n < width);
+
+  while (pad && n < width){
+    digits[n++] = 0;
+  }
 
-  if (get_game_time() > 9){
-    draw_string(65, 1, ":");
-    draw_string(70, 1, timer_count);
+  for (uint8_t i = 0; i < width; i++){
+    hud_text[slot + i] = i < n ? digits[n - 1 - i] : HUD_BLANK;
   }
+}
 
-  if (get_game_time() > 59){
-    ovf_count = 0;
-    min++;
+  //Updates the minutes and seconds once the game clock passes hud_next_ms,
+  //then waits for the frame that will see the next second. A reset game
+  //clock runs behind the last boundary.
+void hud_clock(void){
+  uint32_t ms = game_clock_ms();
+  if (ms >= hud_next_ms || ms + 1000 < hud_next_ms){
+    uint16_t seconds = ms / 1000;
+    hud_number(HUD_MIN, 2, seconds / 60, true);
+    hud_number(HUD_SEC, 2, seconds % 60, true);
+    hud_next_ms = (uint32_t)(seconds + 1) * 1000;
   }
 
-  show_screen();
+  uint32_t wait = hud_next_ms - ms;
+  wheel_schedule(WHEEL_CLOCK, (wait * TICK_HZ + 999) / 1000);
 }
 
 void ship_setup(void){
   int w = LCD_X - 3, h = LCD_Y - 3;
 
-  int ship_xcor = rand() % w;
-  int ship_ycor = rand() % h;
+  int ship_xcor = rng_below(RNG_SPAWN, w);
+  int ship_ycor = rng_below(RNG_SPAWN, h);
 
   bool setShip = false;
 
-  for (int i = 0; i < MAX_A; i++){
+  for (int k = 0; k < alien_pool.count; k++){
+    Entity* a = POOL_GET(alien_pool, k);
     if (!setShip){
       if (ship_ycor < 15){
         ship_ycor = ship_ycor + 10;
@@ -436,18 +911,20 @@ void ship_setup(void){
         ship_xcor = ship_xcor + 10;
       }
 
-      else if (ship_xcor == alien[i].x){
-        ship_xcor = rand() % w;
+      else if (FIX(ship_xcor) == a->x){
+        ship_xcor = rng_below(RNG_SPAWN, w);
       }
 
-      else if (ship_ycor == alien[i].y){
-        ship_ycor = rand() % h;
+      else if (FIX(ship_ycor) == a->y){
+        ship_ycor = rng_below(RNG_SPAWN, h);
       }
     }
   }
 
-  init_sprite(&ship, ship_xcor, ship_ycor, SHIP_WIDTH, SHIP_HEIGHT, ship_image);
-  draw_sprite(&ship);
+  sprite_init(&ship, ship_xcor, ship_ycor, SHIP_WIDTH, SHIP_HEIGHT, ship_image);
+  ship.type = TYPE_SHIP;
+  sprite_draw(&ship);
+  flow_update();
 
   //turret_setup();
 }
@@ -455,19 +932,19 @@ void ship_setup(void){
 void alien_setup(void){
   int w = LCD_X - 15, h = LCD_Y - 15;
 
-  alienCount = MAX_A;
+  pool_clear(&alien_pool);
 
   for (int i = 0; i < MAX_A; i++){
-    int alien_xcor = rand() % w;
-    int alien_ycor = rand() % h;
+    int alien_xcor = rng_below(RNG_SPAWN, w);
+    int alien_ycor = rng_below(RNG_SPAWN, h);
 
     bool setAlien = false;
 
     while (!setAlien){
-      if (alien_xcor == ship.x){
-        alien_xcor = rand() % w;
-        if (alien_ycor == ship.y){
-          alien_ycor = rand() % h;
+      if (FIX(alien_xcor) == ship.x){
+        alien_xcor = rng_below(RNG_SPAWN, w);
+        if (FIX(alien_ycor) == ship.y){
+          alien_ycor = rng_below(RNG_SPAWN, h);
           if (alien_ycor < 15){
             alien_ycor = 20;
             if (alien_xcor < 15){
@@ -477,41 +954,66 @@ void alien_setup(void){
         }
       }
       setAlien = true;
-      attack[i] = false;
     }
 
-    init_sprite(&alien[i], alien_xcor + 12, alien_ycor + 12, ALIEN_WIDTH, ALIEN_HEIGHT, alien_image);
-    draw_sprite(&alien[i]);
+    Entity* a = pool_acquire(&alien_pool);
+    sprite_init(a, alien_xcor + 12, alien_ycor + 12, ALIEN_WIDTH, ALIEN_HEIGHT, alien_image);
+    a->type = TYPE_ALIEN;
+    alien_idle(a - alien);
+    sprite_draw(a);
   }
 }
 
 void missile_setup(void){
-  int mis_xcor = ship.x + SHIP_WIDTH / 2;
-  int mis_ycor = ship.y - SHIP_HEIGHT / 2;
+  int mis_xcor = FIX_INT(ship.x) + SHIP_WIDTH / 2;
+  int mis_ycor = FIX_INT(ship.y) - SHIP_HEIGHT / 2;
 
   for (int i = 0; i < MAX_M; i++){
+    sprite_init(&missile[i], mis_xcor, mis_ycor, MISSILE_WIDTH, MISSILE_HEIGHT, missile_image);
+    missile[i].type = TYPE_MISSILE;
+  }
 
-    init_sprite(&missile[i], mis_xcor, mis_ycor, MISSILE_WIDTH, MISSILE_HEIGHT, missile_image);
+  pool_clear(&missile_pool);
+}
 
-    draw_sprite(&missile[i]);
-    sprite_hide(&missile[i]);
+  //Launches a missile from the ship in the direction it faces, if one is free
+void missile_fire(void){
+  Entity* m = pool_acquire(&missile_pool);
+  if (m == NULL){
+    return;
   }
 
+  int xcor = FIX_INT(ship.x) + SHIP_WIDTH / 2;
+  int ycor = FIX_INT(ship.y) + SHIP_HEIGHT / 2;
+  sprite_move_to(m, FIX(xcor), FIX(ycor));
+
+  if (direction == "Up"){
+    sprite_turn_to(m, 0, FIX(-1.5));
+  }
+  else if (direction == "Down"){
+    sprite_turn_to(m, 0, FIX(+1.5));
+  }
+  else if (direction == "Right"){
+    sprite_turn_to(m, FIX(+1.5), 0);
+  }
+  else if (direction == "Left"){
+    sprite_turn_to(m, FIX(-1.5), 0);
+  }
 }
 
 void mothership_setup(void){
   mothershipActive = true;
   bossHealth = 10;
-  mothershipAttack = false;
+  mothership_idle();
   int w = LCD_X - 20, h = LCD_Y - 20;
 
-  int ms_xcor = rand() % w;
-  int ms_ycor = rand() % h;
+  int ms_xcor = rng_below(RNG_SPAWN, w);
+  int ms_ycor = rng_below(RNG_SPAWN, h);
 
-  if (ms_xcor == ship.x){
-    ms_xcor = rand() % w;
-    if (ms_ycor == ship.y){
-      ms_ycor = rand() % h;
+  if (FIX(ms_xcor) == ship.x){
+    ms_xcor = rng_below(RNG_SPAWN, w);
+    if (FIX(ms_ycor) == ship.y){
+      ms_ycor = rng_below(RNG_SPAWN, h);
       if (ms_ycor < 15){
         ms_ycor = 20;
         if (ms_xcor < 15){
@@ -521,32 +1023,39 @@ void mothership_setup(void){
     }
   }
 
-  init_sprite(&mothership, ms_xcor + 12, ms_ycor + 12, MOTHERSHIP_WIDTH, MOTHERSHIP_HEIGHT, mothership_full);
-  draw_sprite(&mothership);
+  sprite_init(&mothership, ms_xcor + 12, ms_ycor + 12, MOTHERSHIP_WIDTH, MOTHERSHIP_HEIGHT, mothership_full);
+  mothership.type = TYPE_MOTHERSHIP;
+  sprite_draw(&mothership);
   sprite_hide(&mothership);
 
   msMissile_setup();
 }
 
 void msMissile_setup(void){
-  init_sprite(&msMissile, 30, 30, msMISSILE_WIDTH, msMISSILE_HEIGHT, msMissile_image);
-  draw_sprite(&msMissile);
-  sprite_hide(&msMissile);
+  for (int i = 0; i < MAX_MS; i++){
+    sprite_init(&msMissile[i], 30, 30, msMISSILE_WIDTH, msMISSILE_HEIGHT, msMissile_image);
+    msMissile[i].type = TYPE_MSMISSILE;
+  }
+
+  pool_clear(&msMissile_pool);
 }
 
 void turret_setup(void){
-  init_sprite(&turret, ship.x, ship.y, TURRET_WIDTH, TURRET_HEIGHT, turret_image);
+  sprite_init(&turret, FIX_INT(ship.x), FIX_INT(ship.y), TURRET_WIDTH, TURRET_HEIGHT, turret_image);
+  turret.type = TYPE_TURRET;
 }
 
+  //Points the turret along the potentiometer angle (degrees, as shown)
 void turret_calc(void){
-  turret.dx = angle;
-  turret.dy = angle;
+  sprite_aim(&turret, ((uint32_t)angle * 182) >> 8, FIX_ONE);
 }
 
 void process(void){
-  gametime = true;
+  BENCH_MARK(BENCH_MOVEMENT);
+  STACK_PROBE(STACK_PROCESS);
+  PROFILE_BEGIN(PROFILE_INPUT);
 
-  char key = usb_serial_getchar();
+  uint8_t buttons = input.buttons | input_key_buttons(input.key);
 
 //Ship-related code
   int topWall = 11;
@@ -554,255 +1063,253 @@ void process(void){
   int bottomWall = LCD_Y - 4;
   int leftWall = 2;
 
-  int sx = ship.x;
-  int sy = ship.y;
+  int sx = FIX_INT(ship.x);
+  int sy = FIX_INT(ship.y);
 
   //Move up
-  if ((((PIND>>1) & 0b1) || key == 'w') && sy > topWall){
-    init_sprite(&ship, sx, sy - 1, SHIP_WIDTH, SHIP_HEIGHT, ship_image);
-    draw_sprite(&ship);
+  if ((buttons & BUTTON_UP) && sy > topWall){
+    sprite_init(&ship, sx, sy - 1, SHIP_WIDTH, SHIP_HEIGHT, ship_image);
     direction = "Up";
   }
 
   //Move right
-  if ((((PIND>>0) & 0b1) || key == 'd') && sx < rightWall){
-    init_sprite(&ship, sx + 1, sy, SHIP_WIDTH, SHIP_HEIGHT, ship_right);
-    draw_sprite(&ship);
+  if ((buttons & BUTTON_RIGHT) && sx < rightWall){
+    sprite_init(&ship, sx + 1, sy, SHIP_WIDTH, SHIP_HEIGHT, ship_right);
     direction = "Right";
   }
 
   //Move down
-  if ((((PINB>>7) & 0b1) || key == 's') && sy < bottomWall){
-    init_sprite(&ship, sx, sy + 1, SHIP_WIDTH, SHIP_HEIGHT, ship_down);
-    draw_sprite(&ship);
+  if ((buttons & BUTTON_DOWN) && sy < bottomWall){
+    sprite_init(&ship, sx, sy + 1, SHIP_WIDTH, SHIP_HEIGHT, ship_down);
     direction = "Down";
   }
 
   //Move left
-  if ((((PINB>>1) & 0b1) || key == 'a') && sx > leftWall){
-    init_sprite(&ship, sx - 1, sy, SHIP_WIDTH, SHIP_HEIGHT, ship_left);
-    draw_sprite(&ship);
+  if ((buttons & BUTTON_LEFT) && sx > leftWall){
+    sprite_init(&ship, sx - 1, sy, SHIP_WIDTH, SHIP_HEIGHT, ship_left);
     direction = "Left";
   }
 
+  PROFILE_END(PROFILE_INPUT);
+
 //Alien-related code
-  for (int i = 0; i < MAX_A; i++){
-    int ax = alien[i].x;
-    int ay = alien[i].y;
+  PROFILE_BEGIN(PROFILE_ALIENS);
+  flow_update();
+
+  for (int k = 0; k < alien_pool.count; k++){
+    int i = alien_pool.slot[k];
+    int ax = FIX_INT(alien[i].x);
+    int ay = FIX_INT(alien[i].y);
 
     //Move towards player
     if (attack[i] == true){
+#if HOMING
+      alien_attack(&alien[i]);
+#else
       sprite_turn_to(&alien[i], alien[i].dx, alien[i].dy);
+#endif
       sprite_step(&alien[i]);
-      draw_sprite(&alien[i]);
 
       //Testing if the aliens hit the walls
       if (ay < topWall + 1 || ay >= bottomWall - 1 || ax >= rightWall - 1 || ax <= leftWall + 1){
-        attack[i] = false;
+        alien_idle(i);
       }
     }
   }
 
-  for (int i = 0; i < MAX_A; i++){
-    if (&alien[i].is_visible){
-      if (!attack[i]){
-        if (rand() % 30 == rand() % 30){
-          sprite_step(&alien[i]);
-          attack[i] = true;
-          alien_attack(&alien[i]);
-        }
-      }
-    }
-  }
+  //Launches the attacks, shots and jobs that are due
+  wheel_tick();
+
+  PROFILE_END(PROFILE_ALIENS);
 
 //Mothership-related code
-  int msx = mothership.x;
-  int msy = mothership.y;
+  PROFILE_BEGIN(PROFILE_MOTHERSHIP);
+  int msx = FIX_INT(mothership.x);
+  int msy = FIX_INT(mothership.y);
 
   //Move towards player
   if (mothershipAttack == true){
+#if HOMING
+    mothership_attack(&mothership);
+#else
     sprite_turn_to(&mothership, mothership.dx, mothership.dy);
+#endif
     sprite_step(&mothership);
-    draw_sprite(&mothership);
 
     //Testing if the mothership hit the walls
     if (msy == topWall + 1|| msy == bottomWall - 5 || msx == rightWall - 5 || msx == leftWall + 1){
-      mothershipAttack = false;
+      mothership_idle();
     }
 
   }
 
-  if (!mothershipAttack){
-    if (rand() % 50 == rand() % 50){
-      mothershipAttack = true;
-      mothership_attack(&mothership);
-    }
-  }
-
 
-  sprite_turn_to(&msMissile, msMissile.dx, msMissile.dy);
-  sprite_step(&msMissile);
+  for (int k = msMissile_pool.count - 1; k >= 0; k--){
+    Entity* m = POOL_GET(msMissile_pool, k);
+    sprite_step(m);
 
-  if (mothershipActive == true){
-    if (!msMissile.is_visible){
-      if (rand() % 10 == rand() % 10){
-        int mxcor = mothership.x + MOTHERSHIP_WIDTH / 2;
-        int mycor = mothership.y + MOTHERSHIP_HEIGHT / 2;
-        sprite_move_to(&msMissile, mxcor, mycor);
-        msMissile_attack(&msMissile);
-        sprite_show(&msMissile);
-      }
+    if (m->y < FIX(10) || m->y > FIX(LCD_Y) || m->x < FIX(1) || m->x > FIX(LCD_X)) {
+      pool_release(&msMissile_pool, m);
     }
   }
 
-  if (msMissile.y < 10 || msMissile.y > LCD_Y || msMissile.x < 1 || msMissile.x > LCD_X) {
-    sprite_hide(&msMissile);
-  }
 
+  PROFILE_END(PROFILE_MOTHERSHIP);
 
 //Missile-related code
+  PROFILE_BEGIN(PROFILE_MISSILES);
   //Fire missile
-  for (int i = 0; i < MAX_M; i++){
-    if (((PINF>>5) & 0b1) || key == 'k'){
-      _delay_ms(10);
-      if (!(missile[i].is_visible)){
-        sprite_show(&missile[i]);
-        int xcor = ship.x + SHIP_WIDTH / 2;
-        int ycor = ship.y + SHIP_HEIGHT / 2;
-        sprite_move_to(&missile[i], xcor, ycor);
-        break;
-      }
-    }
+  if (buttons & BUTTON_FIRE){
+    missile_fire();
   }
 
-  //Missile Direction
-  for (int i = 0; i < MAX_M; i++){
-    if (updateDirection[i] == true){
-      if (direction == "Up"){
-        sprite_turn_to(&missile[i], 0, -1.5);
-        updateDirection[i] = false;
-        }
-      else if (direction == "Down"){
-        sprite_turn_to(&missile[i], 0, +1.5);
-        updateDirection[i] = false;
-      }
-      else if (direction == "Right"){
-        sprite_turn_to(&missile[i], +1.5, 0);
-        updateDirection[i] = false;
-      }
-      else if (direction == "Left"){
-        sprite_turn_to(&missile[i], -1.5, 0);
-        updateDirection[i] = false;
-      }
-    }
-  }
-
-  for (int i = 0; i < MAX_M; i++){
-    sprite_step(&missile[i]);
-    if (missile[i].y < 10 || missile[i].y > LCD_Y || missile[i].x < 1 || missile[i].x > LCD_X) {
-      sprite_hide(&missile[i]);
-    }
+  for (int k = missile_pool.count - 1; k >= 0; k--){
+    Entity* m = POOL_GET(missile_pool, k);
+    sprite_step(m);
 
-    if (missile[i].is_visible){
-      updateDirection[i] = false;
-    }
-    else if (!(missile[i].is_visible)){
-      updateDirection[i] = true;
+    if (m->y < FIX(10) || m->y > FIX(LCD_Y) || m->x < FIX(1) || m->x > FIX(LCD_X)) {
+      pool_release(&missile_pool, m);
     }
   }
 
   //Potentiometer
-  char my_buffer[80];
-    //Start conversion
-  ADCSRA |= 0b1 << 6;
-  while (ADCSRA & (0b1 << 6)); //Wait until it's finished
-  adc_value = ADC; //Grab the value
-  int angle = ADC / 1.42; //Convert to degrees
+  char my_buffer[6];
+  int my_length;
+  adc_value = input.adc; //Filtered ADC_vect value, sampled with the frame
+  angle = ((uint32_t)adc_value * 46153) >> 16; //Convert to degrees (ADC / 1.42)
 
     //Convert value to string
-  sprintf(my_buffer, "%d", angle);
+  my_length = sprintf(my_buffer, "%d", angle);
 
   //Turn turret
-  //turret_calc();
+  turret_calc();
   //sprite_move_to(&turret, ship.x + 1, ship.y + 1);
+  PROFILE_END(PROFILE_MISSILES);
 
 
-
+  BENCH_MARK(BENCH_COLLISION);
+  PROFILE_BEGIN(PROFILE_COLLISION);
   collision_checker();
+  PROFILE_END(PROFILE_COLLISION);
 
+  BENCH_MARK(BENCH_RENDER);
+  PROFILE_BEGIN(PROFILE_RENDER);
   clear_screen();
 
-  draw_sprite(&ship);
+  sprite_draw(&ship);
 
   // sprite_turn(&turret, 1);
   // sprite_step(&turret);
-  // draw_sprite(&turret);
+  // sprite_draw(&turret);
 
-  for (int i = 0; i < MAX_A; i++){
-    draw_sprite(&alien[i]);
+  for (int k = 0; k < alien_pool.count; k++){
+    sprite_draw(POOL_GET(alien_pool, k));
   }
 
-  for (int i = 0; i < MAX_M; i++){
-    draw_sprite(&missile[i]);
+  for (int k = 0; k < missile_pool.count; k++){
+    sprite_draw(POOL_GET(missile_pool, k));
   }
 
   if (mothershipActive == true){
-    draw_sprite(&mothership);
-    draw_sprite(&msMissile);
+    sprite_draw(&mothership);
+    for (int k = 0; k < msMissile_pool.count; k++){
+      sprite_draw(POOL_GET(msMissile_pool, k));
+    }
     sprite_show(&mothership);
   }
 
   //Display angle value
   draw_string(20, 20, my_buffer);
+  dirty_mark(20, 20, my_length * 5, 8);
 
   border();
+  PROFILE_BEGIN(PROFILE_STATUS);
   status_display();
+  PROFILE_END(PROFILE_STATUS);
+
+  dirty_flush();
+  PROFILE_END(PROFILE_RENDER);
 }
 
-void alien_attack(Sprite* alien){
-  alien->dx = ship.x - alien->x;
-  alien->dy = ship.y - alien->y;
+void alien_attack(Entity* alien){
+#if HOMING
+  flow_aim(alien, FIX(1.5));
+#else
+  sprite_aim_at(alien, ship.x, ship.y, FIX(1.5));
+#endif
+}
 
-  dist = sqrt((alien->dx * alien->dx) + (alien->dy * alien->dy));
+void mothership_attack(Entity* mothership){
+#if HOMING
+  flow_aim(mothership, FIX(0.75));
+#else
+  sprite_aim_at(mothership, ship.x, ship.y, FIX(0.75));
+#endif
+}
 
-  alien->dx = alien->dx * 1.5 / dist;
-  alien->dy = alien->dy * 1.5 / dist;
+void msMissile_attack(Entity* msMissile){
+  sprite_aim_at(msMissile, ship.x, ship.y, FIX_ONE);
 }
 
-void mothership_attack(Sprite* mothership){
-  mothership->dx = ship.x - mothership->x;
-  mothership->dy = ship.y - mothership->y;
+  //Stops an alien's attack and schedules its next one
+void alien_idle(uint8_t i){
+  attack[i] = false;
+  wheel_schedule(WHEEL_ALIEN + i, rng_delay(RNG_ALIEN, ALIEN_ATTACK_FRAMES));
+}
 
-  dist = sqrt((mothership->dx * mothership->dx) + (mothership->dy * mothership->dy));
+void alien_launch(uint8_t i){
+  if (alien[i].sprite.is_visible && !attack[i]){
+    sprite_step(&alien[i]);
+    attack[i] = true;
+    alien_attack(&alien[i]);
+  }
+}
 
-  mothership->dx = mothership->dx * 0.75 / dist;
-  mothership->dy = mothership->dy * 0.75 / dist;
+void mothership_idle(void){
+  mothershipAttack = false;
+  wheel_schedule(WHEEL_MOTHERSHIP, rng_delay(RNG_MOTHERSHIP, MOTHERSHIP_ATTACK_FRAMES));
 }
 
-void msMissile_attack(Sprite* msMissile){
-  msMissile->dx = ship.x - msMissile->x;
-  msMissile->dy = ship.y - msMissile->y;
+void mothership_launch(void){
+  mothershipAttack = true;
+  mothership_attack(&mothership);
+}
 
-  dist = sqrt((msMissile->dx * msMissile->dx) + (msMissile->dy * msMissile->dy));
+  //Fires from the mothership's centre, if it is out and a missile is free.
+  //The next shot is scheduled either way.
+void msMissile_fire(void){
+  if (mothershipActive == true){
+    if (msMissile_pool.count < MAX_MS){
+      Entity* m = pool_acquire(&msMissile_pool);
+      int mxcor = FIX_INT(mothership.x) + MOTHERSHIP_WIDTH / 2;
+      int mycor = FIX_INT(mothership.y) + MOTHERSHIP_HEIGHT / 2;
+      sprite_move_to(m, FIX(mxcor), FIX(mycor));
+      msMissile_attack(m);
+    }
+  }
 
-  msMissile->dx = msMissile->dx / dist;
-  msMissile->dy = msMissile->dy / dist;
+  wheel_schedule(WHEEL_MS_MISSILE, rng_delay(RNG_MOTHERSHIP, MS_MISSILE_FRAMES));
 }
 
 void collision_checker(){
+  uint8_t found[MAX_A];
+  uint8_t count;
+
+  STACK_PROBE(STACK_COLLISION);
+
+  grid_build();
+
   //Check if the alien and ship collide
-  for (int i = 0; i < MAX_A; i++){
-    if (alien[i].is_visible){
-      if (collision_SnA(&alien[i])){
-        for (int j = 0; j < MAX_M; j++){
-          sprite_hide(&missile[j]);
-        }
+  count = grid_query(&ship, found);
+  for (int k = 0; k < count; k++){
+    int i = found[k];
+    if (alien[i].sprite.is_visible){
+      if (collision(&ship, &alien[i])){
+        pool_clear(&missile_pool);
         if (lives > 1){
           ship_setup();
-          _delay_ms(10);
           lives -= 1;
-          char message[] = "An Alien has killed the Player.";
-          send_debug_string(message);
+          send_debug_string(PSTR("An Alien has killed the Player."));
         }
         else if (lives == 1){
           game_end();
@@ -813,23 +1320,21 @@ void collision_checker(){
 
 
   //Check if missile and alien collide
-  for (int i = 0; i < MAX_A; i++){
-    if (alien[i].is_visible){
-      for (int j = 0; j < MAX_M; j++){
-        if (missile[j].is_visible){
-          if (collision_MnA(&missile[j], &alien[i])){
-            char message[] = "The Player has killed an Alien.";
-            send_debug_string(message);
-            sprite_move_to(&missile[j], -100 * 10, -100 * 10);
-            _delay_ms(10);
-            score += 1;
-            alienCount -= 1;
-            sprite_hide(&missile[j]);
-            sprite_hide(&alien[i]);
-            if (alienCount == 0){
-              mothership_setup();
-            }
+  for (int j = missile_pool.count - 1; j >= 0; j--){
+    Entity* m = POOL_GET(missile_pool, j);
+    count = grid_query(m, found);
+    for (int k = 0; k < count; k++){
+      int i = found[k];
+      if (alien[i].sprite.is_visible){
+        if (collision(m, &alien[i])){
+          send_debug_string(PSTR("The Player has killed an Alien."));
+          score += 1;
+          pool_release(&missile_pool, m);
+          pool_release(&alien_pool, &alien[i]);
+          if (alien_pool.count == 0){
+            mothership_setup();
           }
+          break;
         }
       }
     }
@@ -838,14 +1343,12 @@ void collision_checker(){
   //Check if ship and mothership collide
   if (mothershipActive == true){
 
-      if (collision_MSnS()){
-        if (&mothership.is_visible){
+      if (collision(&ship, &mothership)){
+        if (&mothership.sprite.is_visible){
           if (lives > 1){
             ship_setup();
-            _delay_ms(10);
             lives -= 1;
-            char message[] = "The Mothership has killed the Player.";
-            send_debug_string(message);
+            send_debug_string(PSTR("The Mothership has killed the Player."));
           }
         }
         else if (lives == 1){
@@ -855,52 +1358,47 @@ void collision_checker(){
 
 
     //Check if missile and mothership collide
-    for (int i = 0; i < MAX_M; i++){
-      if (&mothership.is_visible){
-        if (missile[i].is_visible){
-          if (collision_MSnM(&missile[i])){
-            sprite_move_to(&missile[i], -100 * 10, -100 * 10);
-            sprite_hide(&missile[i]);
-            _delay_ms(10);
-            bossHealth -= 1;
-            if (bossHealth == 8){
-              sprite_set_image(&mothership, mothership_34);
-              mothershipAttack == true;
-            }
-            if (bossHealth == 6){
-              sprite_set_image(&mothership, mothership_half);
-              mothershipAttack == true;
-            }
-            if (bossHealth == 4){
-              sprite_set_image(&mothership, mothership_14);
-              mothershipAttack == true;
-            }
-            if (bossHealth == 2){
-              sprite_set_image(&mothership, mothership_dead);
-              mothershipAttack == true;
-            }
-            if (bossHealth == 1){
-              sprite_hide(&mothership);
-              mothershipActive = false;
-              score += 10;
-              alien_setup();
-            }
+    for (int j = missile_pool.count - 1; j >= 0; j--){
+      Entity* m = POOL_GET(missile_pool, j);
+      if (&mothership.sprite.is_visible){
+        if (collision(m, &mothership)){
+          pool_release(&missile_pool, m);
+          bossHealth -= 1;
+          if (bossHealth == 8){
+            sprite_set_image(&mothership, mothership_34);
+            mothershipAttack == true;
+          }
+          if (bossHealth == 6){
+            sprite_set_image(&mothership, mothership_half);
+            mothershipAttack == true;
+          }
+          if (bossHealth == 4){
+            sprite_set_image(&mothership, mothership_14);
+            mothershipAttack == true;
+          }
+          if (bossHealth == 2){
+            sprite_set_image(&mothership, mothership_dead);
+            mothershipAttack == true;
+          }
+          if (bossHealth == 1){
+            sprite_hide(&mothership);
+            mothershipActive = false;
+            score += 10;
+            alien_setup();
           }
         }
       }
     }
 
     //Check if ship and mothership's missle collide
-    if (msMissile.is_visible){
-      if (collision_MsMnS()){
+    for (int k = msMissile_pool.count - 1; k >= 0; k--){
+      Entity* m = POOL_GET(msMissile_pool, k);
+      if (collision(&ship, m)){
         if (lives > 1){
-          sprite_move_to(&msMissile, -100 * 10, -100 * 10);
-          sprite_hide(&msMissile);
+          pool_release(&msMissile_pool, m);
           ship_setup();
-          _delay_ms(10);
           lives -= 1;
-          char message[] = "The Mothership has killed the Player.";
-          send_debug_string(message);
+          send_debug_string(PSTR("The Mothership has killed the Player."));
         }
       }
       else if (lives == 1){
@@ -912,155 +1410,225 @@ void collision_checker(){
 
 }
 
+  //Ends the game from inside the frame; the main loop shows the game over
+  //screen once process() returns
 void game_end(){
-  gametime = false;
-  clear_screen();
-
-  int h = LCD_Y;
+  game_clock_pause();
+  scene_set(SCENE_GAME_OVER);
+}
 
-  draw_string(17, h / 2 - 20, "The game");
-  draw_string(14, h / 2 - 12, "has ended.");
-  draw_string(7, h / 2 + 8, "Press a button");
-  draw_string(7, h / 2 + 16, "to play again...");
+void game_over_screen(void){
+  if (scene_enter()){
+    clear_screen();
 
-  show_screen();
+    int h = LCD_Y;
 
-  while (! (((PINF>>5) & 0b1) | ((PINF>>6) & 0b1)));
+    draw_string_P(17, h / 2 - 20, PSTR("The game"));
+    draw_string_P(14, h / 2 - 12, PSTR("has ended."));
+    draw_string_P(7, h / 2 + 8, PSTR("Press a button"));
+    draw_string_P(7, h / 2 + 16, PSTR("to play again..."));
 
-  if ((((PINF>>5) & 0b1) | ((PINF>>6) & 0b1))){
-    while ((PINF>>5) & 0b1);
-    while ((PINF>>6) & 0b1);
+    screen_show();
   }
-  lives = 6;
-  score = 0;
-
-  clear_screen();
-
-  main();
 
+  //A restart goes straight to the countdown; the intro is only for power on
+  if (scene_button()){
+    clear_screen();
+    restart_since = clock_ticks();
+    restart_pending = true;
+    scene_set(SCENE_COUNTDOWN);
+  }
 }
 
-bool collision_SnA(Sprite* alien){
+bool collision(Entity* a, Entity* b){
+  BENCH_COUNT(pair_tests);
   bool collided = true;
 
-  int ship_top = round(ship.y);
-  int ship_bottom = ship_top + SHIP_HEIGHT - 1;
-  int ship_left = round(ship.x);
-  int ship_right = ship_left + SHIP_WIDTH - 1;
+  int a_top = FIX_ROUND(a->y);
+  int a_bottom = a_top + hitbox[a->type].h - 1;
+  int a_left = FIX_ROUND(a->x);
+  int a_right = a_left + hitbox[a->type].w - 1;
 
-  int alien_top = round(alien->y);
-  int alien_bottom = alien_top + ALIEN_HEIGHT - 1;
-  int alien_left = round(alien->x);
-  int alien_right = alien_left + ALIEN_WIDTH - 1;
+  int b_top = FIX_ROUND(b->y);
+  int b_bottom = b_top + hitbox[b->type].h - 1;
+  int b_left = FIX_ROUND(b->x);
+  int b_right = b_left + hitbox[b->type].w - 1;
 
-  if (alien_bottom < ship_top) collided = false;
-  else if (alien_top > ship_bottom) collided = false;
-  else if (alien_right < ship_left) collided = false;
-  else if (alien_left > ship_right) collided = false;
+  if (b_bottom < a_top) collided = false;
+  else if (b_top > a_bottom) collided = false;
+  else if (b_right < a_left) collided = false;
+  else if (b_left > a_right) collided = false;
+
+#if PIXEL_COLLISION
+  if (collided){
+    collided = collision_pixels(a, b);
+  }
+#endif
 
   return collided;
+}
 
+//POOL FUNCTIONS
+  //Frees every entity, returning the pool to slot order
+void pool_clear(Pool* pool){
+  for (int i = 0; i < pool->capacity; i++){
+    pool->slot[i] = i;
+    pool->where[i] = i;
+    sprite_hide(&pool->entity[i]);
+  }
+  pool->count = 0;
 }
 
-bool collision_MnA(Sprite* missile, Sprite* alien){
-  bool collided = true;
+Entity* pool_acquire(Pool* pool){
+  if (pool->count == pool->capacity){
+    return NULL;
+  }
 
-  int missile_top = round(missile->y);
-  int missile_bottom = missile_top + MISSILE_HEIGHT;
-  int missile_left = round(missile->x);
-  int missile_right = missile_left + MISSILE_WIDTH;
+  Entity* entity = &pool->entity[pool->slot[pool->count++]];
+  sprite_show(entity);
+  return entity;
+}
 
-  int alien_top = round(alien->y);
-  int alien_bottom = alien_top + ALIEN_HEIGHT - 1;
-  int alien_left = round(alien->x);
-  int alien_right = alien_left + ALIEN_WIDTH - 1;
+  //Moves the last live slot into the released one's place. Loops that
+  //release while iterating run from the back so nothing is skipped.
+void pool_release(Pool* pool, Entity* entity){
+  uint8_t i = entity - pool->entity;
+  uint8_t pos = pool->where[i];
+  uint8_t last = pool->slot[--pool->count];
 
-  if (alien_bottom < missile_top) collided = false;
-  else if (alien_top > missile_bottom) collided = false;
-  else if (alien_right < missile_left) collided = false;
-  else if (alien_left > missile_right) collided = false;
+  pool->slot[pos] = last;
+  pool->where[last] = pos;
+  pool->slot[pool->count] = i;
+  pool->where[i] = pool->count;
 
-  return collided;
+  sprite_hide(entity);
 }
 
-bool collision_MSnS(void){
-  bool collided = true;
+  //Sprite images are at most 8 pixels wide: one byte per row, MSB leftmost
+bool collision_pixels(Entity* a, Entity* b){
+  BENCH_COUNT(pixel_tests);
 
-  int ship_top = round(ship.y);
-  int ship_bottom = ship_top + SHIP_HEIGHT - 1;
-  int ship_left = round(ship.x);
-  int ship_right = ship_left + SHIP_WIDTH - 1;
+  int ax = FIX_ROUND(a->x), ay = FIX_ROUND(a->y);
+  int bx = FIX_ROUND(b->x), by = FIX_ROUND(b->y);
 
-  int mothership_top = round(mothership.y);
-  int mothership_bottom = mothership_top + MOTHERSHIP_HEIGHT - 1;
-  int mothership_left = round(mothership.x);
-  int mothership_right = mothership_left + MOTHERSHIP_WIDTH - 1;
+  //Make a the leftmost so b's rows shift right into a's columns
+  if (bx < ax){
+    Entity* t = a; a = b; b = t;
+    int tx = ax; ax = bx; bx = tx;
+    int ty = ay; ay = by; by = ty;
+  }
 
-  if (mothership_bottom < ship_top) collided = false;
-  else if (mothership_top > ship_bottom) collided = false;
-  else if (mothership_right < ship_left) collided = false;
-  else if (mothership_left > ship_right) collided = false;
+  int shift = bx - ax;
+  if (shift > 7){
+    return false;
+  }
 
-  return collided;
+  int top = ay > by ? ay : by;
+  int a_end = ay + collision_height(a);
+  int b_end = by + collision_height(b);
+  int bottom = a_end < b_end ? a_end : b_end;
+
+  for (int row = top; row < bottom; row++){
+    if (collision_row(a, row - ay) & (collision_row(b, row - by) >> shift)){
+      return true;
+    }
+  }
+
+  return false;
 }
 
-bool collision_MSnM(Sprite* missile){
-  bool collided = true;
+  //Rows the pixel test covers: the image, or the hitbox where it is taller
+int collision_height(Entity* e){
+  int h = hitbox[e->type].h;
+  return h > e->sprite.height ? h : e->sprite.height;
+}
+
+  //One row of the mask the pixel test uses. Where the hitbox is larger than
+  //the image (the missile's reaches one pixel further), the image is smeared
+  //right and down to fill it, so the pixel test keeps that margin.
+uint8_t collision_row(Entity* e, int row){
+  int pad_w = hitbox[e->type].w - e->sprite.width;
+  int pad_h = hitbox[e->type].h - e->sprite.height;
+  uint8_t mask = 0;
+
+  for (int r = pad_h > 0 ? row - pad_h : row; r <= row; r++){
+    if (r >= 0 && r < e->sprite.height){
+      uint8_t bits = pgm_read_byte(&e->sprite.bitmap[r]);
+      mask |= bits;
+      for (int p = 1; p <= pad_w; p++){
+        mask |= bits >> p;
+      }
+    }
+  }
 
-  int missile_top = round(missile->y);
-  int missile_bottom = missile_top + MISSILE_HEIGHT;
-  int missile_left = round(missile->x);
-  int missile_right = missile_left + MISSILE_WIDTH;
+  return mask;
+}
 
-  int mothership_top = round(mothership.y);
-  int mothership_bottom = mothership_top + MOTHERSHIP_HEIGHT - 1;
-  int mothership_left = round(mothership.x);
-  int mothership_right = mothership_left + MOTHERSHIP_WIDTH - 1;
+int grid_clamp(int value, int limit){
+  return value < 0 ? 0 : (value >= limit ? limit - 1 : value);
+}
 
-  if (mothership_bottom < missile_top) collided = false;
-  else if (mothership_top > missile_bottom) collided = false;
-  else if (mothership_right < missile_left) collided = false;
-  else if (mothership_left > missile_right) collided = false;
+void grid_build(void){
+  for (int c = 0; c < GRID_W * GRID_H; c++){
+    grid_head[c] = GRID_NONE;
+  }
 
-  return collided;
+  for (int k = 0; k < alien_pool.count; k++){
+    int i = alien_pool.slot[k];
+    int cx = grid_clamp(FIX_ROUND(alien[i].x), LCD_X) / GRID_CELL;
+    int cy = grid_clamp(FIX_ROUND(alien[i].y), LCD_Y) / GRID_CELL;
+    int c = cy * GRID_W + cx;
+    grid_next[i] = grid_head[c];
+    grid_head[c] = i;
+  }
 }
 
-bool collision_MsMnS(void){
-  bool collided = true;
+  //Fills found[] with the aliens that may overlap entity and returns how many
+uint8_t grid_query(Entity* entity, uint8_t found[]){
+  uint8_t count = 0;
 
-  int ship_top = round(ship.y);
-  int ship_bottom = ship_top + SHIP_HEIGHT - 1;
-  int ship_left = round(ship.x);
-  int ship_right = ship_left + SHIP_WIDTH - 1;
+#if BROAD_PHASE
+  int x = FIX_ROUND(entity->x);
+  int y = FIX_ROUND(entity->y);
 
-  int msMissile_top = round(msMissile.y);
-  int msMissile_bottom = msMissile_top + msMISSILE_HEIGHT - 1;
-  int msMissile_left = round(msMissile.x);
-  int msMissile_right = msMissile_left + msMISSILE_WIDTH - 1;
+  //An alien can only overlap if its top left lies within this range
+  int cx0 = grid_clamp(x - (ALIEN_WIDTH - 1), LCD_X) / GRID_CELL;
+  int cx1 = grid_clamp(x + hitbox[entity->type].w - 1, LCD_X) / GRID_CELL;
+  int cy0 = grid_clamp(y - (ALIEN_HEIGHT - 1), LCD_Y) / GRID_CELL;
+  int cy1 = grid_clamp(y + hitbox[entity->type].h - 1, LCD_Y) / GRID_CELL;
 
-  if (msMissile_bottom < ship_top) collided = false;
-  else if (msMissile_top > ship_bottom) collided = false;
-  else if (msMissile_right < ship_left) collided = false;
-  else if (msMissile_left > ship_right) collided = false;
+  for (int cy = cy0; cy <= cy1; cy++){
+    for (int cx = cx0; cx <= cx1; cx++){
+      for (uint8_t i = grid_head[cy * GRID_W + cx]; i != GRID_NONE; i = grid_next[i]){
+        found[count++] = i;
+      }
+    }
+  }
+#else
+  (void)entity;
+  for (int k = 0; k < alien_pool.count; k++){
+    found[count++] = alien_pool.slot[k];
+  }
+#endif
 
-  return collided;
+  return count;
 }
 
-void alien_spawn(Sprite* alien){
+void alien_spawn(Entity* alien){
   int w = LCD_X - 5, h = LCD_Y - 5;
 
-  int alien_xcor = rand() % w;
-  int alien_ycor = rand() % h;
+  int alien_xcor = rng_below(RNG_SPAWN, w);
+  int alien_ycor = rng_below(RNG_SPAWN, h);
 
   bool setAlien = false;
 
   while (!setAlien){
-    if (alien_xcor == ship.x){
-      alien_xcor = rand() % w;
+    if (FIX(alien_xcor) == ship.x){
+      alien_xcor = rng_below(RNG_SPAWN, w);
     }
 
-    else if (alien_ycor == ship.y){
-      alien_ycor = rand() % h;
+    else if (FIX(alien_ycor) == ship.y){
+      alien_ycor = rng_below(RNG_SPAWN, h);
     }
 
     else if (alien_ycor < 15){
@@ -1073,13 +1641,11 @@ void alien_spawn(Sprite* alien){
 
     setAlien = true;
   }
-  sprite_move_to(alien, alien_xcor, alien_ycor);
+  sprite_move_to(alien, FIX(alien_xcor), FIX(alien_ycor));
 }
 
 void ship_info(int x_pos, int y_pos, char* direction){
-  char output[100];
-  sprintf(output, "The ship is now at (%d, %d), and aiming %s.", x_pos, y_pos, direction);
-  send_debug_string(output);
+  log_push(LOG_SHIP, direction, x_pos, y_pos);
 }
 
 
@@ -1087,109 +1653,416 @@ void ship_info(int x_pos, int y_pos, char* direction){
   //Note: These function were retrieved from the cab202_sprites.c file
   //      and were written by Lawrence Buckingham and Ben Talbot.
 
-void sprite_turn_to(Sprite* sprite, double dx, double dy) {
+void sprite_init(Entity* sprite, int x, int y, unsigned char width, unsigned char height, const unsigned char image[]) {
+	init_sprite(&sprite->sprite, x, y, width, height, (unsigned char*)image);
+	sprite->x = FIX( x );
+	sprite->y = FIX( y );
+}
+
+//Draws straight from the flash bitmap; the library's draw_sprite() reads SRAM
+void sprite_draw(Entity* sprite) {
+	if ( ! sprite->sprite.is_visible ) {
+		return;
+	}
+
+	int x = FIX_ROUND( sprite->x );
+	int y = FIX_ROUND( sprite->y );
+	dirty_mark( x, y, sprite->sprite.width, sprite->sprite.height );
+
+	for ( int row = 0; row < sprite->sprite.height; row++ ) {
+		int py = y + row;
+		if ( py < 0 || py >= LCD_Y ) continue;
+
+		unsigned char bits = pgm_read_byte( &sprite->sprite.bitmap[row] );
+		for ( int px = x; bits != 0; px++, bits <<= 1 ) {
+			if ( ( bits & 0x80 ) && px >= 0 && px < LCD_X ) {
+				screen_buffer[( py >> 3 ) * LCD_X + px] |= 1 << ( py & 7 );
+			}
+		}
+	}
+}
+
+void sprite_turn_to(Entity* sprite, fixed dx, fixed dy) {
 	sprite->dx = dx;
 	sprite->dy = dy;
 }
 
-bool sprite_step(Sprite* sprite) {
-	int x0 = round( sprite->x );
-	int y0 = round( sprite->y );
+bool sprite_step(Entity* sprite) {
+	int x0 = FIX_ROUND( sprite->x );
+	int y0 = FIX_ROUND( sprite->y );
 	sprite->x += sprite->dx;
 	sprite->y += sprite->dy;
-	int x1 = round( sprite->x );
-	int y1 = round( sprite->y );
-	return ( x1 != x0 ) || ( y1 != y0 );
+	return ( FIX_ROUND( sprite->x ) != x0 ) || ( FIX_ROUND( sprite->y ) != y0 );
 }
 
-bool sprite_show(Sprite* sprite) {
-	bool old_val = sprite->is_visible;
-	sprite->is_visible = true;
+bool sprite_show(Entity* sprite) {
+	bool old_val = sprite->sprite.is_visible;
+	sprite->sprite.is_visible = true;
 	return ! old_val;
 }
 
-bool sprite_hide(Sprite* sprite) {
-	bool old_val = sprite->is_visible;
-	sprite->is_visible = false;
+bool sprite_hide(Entity* sprite) {
+	bool old_val = sprite->sprite.is_visible;
+	sprite->sprite.is_visible = false;
 	return old_val;
 }
 
-bool sprite_move_to(Sprite* sprite, double x, double y ) {
-	int x0 = round( sprite->x );
-	int y0 = round( sprite->y );
+bool sprite_move_to(Entity* sprite, fixed x, fixed y ) {
+	int x0 = FIX_ROUND( sprite->x );
+	int y0 = FIX_ROUND( sprite->y );
 	sprite->x = x;
 	sprite->y = y;
-	int x1 = round( sprite->x );
-	int y1 = round( sprite->y );
-	return ( x1 != x0 ) || ( y1 != y0 );
+	return ( FIX_ROUND( sprite->x ) != x0 ) || ( FIX_ROUND( sprite->y ) != y0 );
 }
 
-void sprite_set_image(Sprite* sprite, char image[]) {
-	sprite->bitmap = image;
+void sprite_set_image(Entity* sprite, const unsigned char image[]) {
+	sprite->sprite.bitmap = (unsigned char*)image;
 }
 
-void sprite_turn(Sprite* sprite, double degrees) {
-	double radians = degrees * M_PI / 180;
-	double s = sin( radians );
-	double c = cos( radians );
-	double dx = c * sprite->dx + s * sprite->dy;
-	double dy = -s * sprite->dx + c * sprite->dy;
+//Binary angles run clockwise on screen, as y runs down: turning adds to the
+//heading that trig_atan2() would give
+void sprite_turn(Entity* sprite, uint8_t angle) {
+	int32_t s = trig_sin( angle );
+	int32_t c = trig_cos( angle );
+	fixed dx = ( c * sprite->dx - s * sprite->dy ) >> TRIG_SHIFT;
+	fixed dy = ( s * sprite->dx + c * sprite->dy ) >> TRIG_SHIFT;
 	sprite->dx = dx;
 	sprite->dy = dy;
 }
 
-//TIMER FUNCTIONS
-int get_game_time(void) {
-    return (ovf_count * 65536 + TCNT1) * PRESCALER / FREQUENCY;
+void sprite_aim(Entity* sprite, uint8_t angle, fixed speed) {
+	sprite->dx = ( (int32_t)speed * trig_cos( angle ) ) >> TRIG_SHIFT;
+	sprite->dy = ( (int32_t)speed * trig_sin( angle ) ) >> TRIG_SHIFT;
 }
 
-double get_system_time(void) {
-    return (overflow * 65536 + TCNT1) * PRESCALER / FREQUENCY;
+//Heads for (x, y) at about the given speed, without sqrt. The distance is
+//taken as 123/128 of the longer side plus 51/128 of the shorter, which is
+//within 4.1% of the true length, so the heading is exact to rounding but
+//the speed may be up to 4.3% off (with the rounding of each component).
+//One division, no floating point.
+void sprite_aim_at(Entity* sprite, fixed x, fixed y, fixed speed) {
+	int32_t dx = x - sprite->x;
+	int32_t dy = y - sprite->y;
+	int32_t ax = dx < 0 ? -dx : dx;
+	int32_t ay = dy < 0 ? -dy : dy;
+	int32_t length = ax > ay ? ( 123 * ax + 51 * ay ) >> 7 : ( 123 * ay + 51 * ax ) >> 7;
+	if ( length == 0 ) {
+		sprite->dx = 0;
+		sprite->dy = 0;
+		return;
+	}
+	int32_t scale = ( (int32_t)speed << 16 ) / length;
+	sprite->dx = ( dx * scale + 0x8000 ) >> 16;
+	sprite->dy = ( dy * scale + 0x8000 ) >> 16;
 }
 
-//DEBUGGER FUNCTIONS
-void check_debugger(){
-  draw_centred(17, "Waiting for");
-  draw_centred(24, "debugger...");
-  show_screen();
-  send_line("Waiting for usb connection...");
-  while(!usb_configured() || !usb_serial_get_control());
-  clear_screen();
+//TRIG FUNCTIONS
+int16_t trig_sin(uint8_t angle){
+  return (int16_t)pgm_read_word(&sine_table[angle]);
+}
+
+int16_t trig_cos(uint8_t angle){
+  return trig_sin(angle + ANGLE_QUARTER);
+}
+
+  //CORDIC in vectoring mode: rotates (dx, dy) onto the +x axis by shifts and
+  //adds, summing the angles turned through. Small vectors are scaled up first
+  //so the shifts keep enough bits.
+uint8_t trig_atan2(int16_t dy, int16_t dx){
+  int32_t x = dx, y = dy;
+  uint16_t turned = 0;
+
+  if (x == 0 && y == 0){
+    return 0;
+  }
+
+  //Start from the right half-plane, where the steps' +-100 degrees suffice
+  if (x < 0){
+    x = -x;
+    y = -y;
+    turned = 0x8000;
+  }
+
+  //y can be negative, so it doubles by multiplying: shifting it left is
+  //undefined
+  while (x < 0x4000 && y < 0x4000 && y > -0x4000){
+    x <<= 1;
+    y *= 2;
+  }
+
+  for (uint8_t i = 0; i < CORDIC_STEPS; i++){
+    int32_t xs = x >> i, ys = y >> i;
+    uint16_t step = pgm_read_word(&cordic_atan[i]);
+    if (y > 0){
+      x += ys;
+      y -= xs;
+      turned += step;
+    }
+    else {
+      x -= ys;
+      y += xs;
+      turned -= step;
+    }
+  }
+
+  return (turned + 0x80) >> 8;
+}
+
+//FLOW FUNCTIONS
+  //Moves the field's origin to the ship's cell
+void flow_update(void){
+  flow_x = grid_clamp(FIX_ROUND(ship.x), LCD_X) / GRID_CELL;
+  flow_y = grid_clamp(FIX_ROUND(ship.y), LCD_Y) / GRID_CELL;
+}
+
+  //Heads for the ship at the given speed: a flash read, two mirrors and
+  //sprite_aim(), with no division. Within a cell of the ship the headings
+  //are too coarse to hit it, so the sprite aims at it directly.
+void flow_aim(Entity* sprite, fixed speed){
+  int x = grid_clamp(FIX_ROUND(sprite->x), LCD_X) / GRID_CELL;
+  int y = grid_clamp(FIX_ROUND(sprite->y), LCD_Y) / GRID_CELL;
+  int ox = flow_x - x, oy = flow_y - y;
+
+  if (ox >= -1 && ox <= 1 && oy >= -1 && oy <= 1){
+    sprite_aim_at(sprite, ship.x, ship.y, speed);
+    return;
+  }
+
+  uint8_t angle = pgm_read_byte(&flow_heading[oy < 0 ? -oy : oy][ox < 0 ? -ox : ox]);
+  if (ox < 0){
+    angle = 2 * ANGLE_QUARTER - angle;
+  }
+  if (oy < 0){
+    angle = -angle;
+  }
+  sprite_aim(sprite, angle, speed);
+}
+
+//DISPLAY FUNCTIONS
+  //The frame is still composed in full in screen_buffer; only the banks and
+  //columns touched this frame or last frame are pushed to the LCD.
+void dirty_mark(int x, int y, int w, int h){
+  if (x < 0){
+    w += x;
+    x = 0;
+  }
+  if (y < 0){
+    h += y;
+    y = 0;
+  }
+  if (x + w > LCD_X){
+    w = LCD_X - x;
+  }
+  if (y + h > LCD_Y){
+    h = LCD_Y - y;
+  }
+  if (w <= 0 || h <= 0){
+    return;
+  }
+
+  for (int bank = y / 8; bank <= (y + h - 1) / 8; bank++){
+    bool empty = dirty_first[bank] == SPAN_EMPTY;
+    if (empty || x < dirty_first[bank]){
+      dirty_first[bank] = x;
+    }
+    if (empty || x + w - 1 > dirty_last[bank]){
+      dirty_last[bank] = x + w - 1;
+    }
+  }
+}
+
+void dirty_all(void){
+  for (int bank = 0; bank < LCD_BANKS; bank++){
+    drawn_first[bank] = 0;
+    drawn_last[bank] = LCD_X - 1;
+    dirty_first[bank] = SPAN_EMPTY;
+  }
+}
+
+  //Sends this frame's spans: all of them before returning, or with LCD_ASYNC
+  //a snapshot of them for the pump, once the previous frame is out
+void dirty_flush(void){
+  dirty_wait();
 
-  //Teensy is successfully connected
-  draw_centred(17, "USB connected.");
-  send_line("The usb has been connected.");
-  send_line("Use W to move up.");
-  send_line("Use A to move left.");
-  send_line("Use S to move down.");
-  send_line("Use D to move right.");
-  send_line("Use K to shoot.");
+  for (int bank = 0; bank < LCD_BANKS; bank++){
+    unsigned char first = dirty_first[bank];
+    unsigned char last = dirty_last[bank];
+
+    if (drawn_first[bank] != SPAN_EMPTY){
+      if (first == SPAN_EMPTY || drawn_first[bank] < first){
+        first = drawn_first[bank];
+      }
+      if (dirty_first[bank] == SPAN_EMPTY || drawn_last[bank] > last){
+        last = drawn_last[bank];
+      }
+    }
+
+#if LCD_ASYNC
+    pump_first[bank] = first;
+    pump_last[bank] = last;
+    if (first != SPAN_EMPTY){
+      memcpy(&lcd_front[bank * LCD_X + first], &screen_buffer[bank * LCD_X + first], last - first + 1);
+    }
+#else
+    if (first != SPAN_EMPTY){
+      lcd_position(first, bank);
+      for (unsigned char x = first; x <= last; x++){
+        lcd_write(LCD_D, screen_buffer[bank * LCD_X + x]);
+      }
+    }
+#endif
+
+    drawn_first[bank] = dirty_first[bank];
+    drawn_last[bank] = dirty_last[bank];
+    dirty_first[bank] = SPAN_EMPTY;
+  }
+
+#if LCD_ASYNC
+  pump_x = pump_first[0];
+  pump_bank = 0;
+  OCR0A = TCNT0 + LCD_PUMP_PERIOD;
+  TIFR0 = 1 << OCF0A;
+  TIMSK0 |= 1 << OCIE0A;
+#else
+  latency_flushed();
+#endif
+}
+
+  //Sleeps until the pump has sent the last frame
+void dirty_wait(void){
+#if LCD_ASYNC
+  cli();
+  while (pump_bank < LCD_BANKS){
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    cli();
+  }
+  sei();
+#endif
+}
+
+  //Called from the pump interrupt: sends up to count bytes of lcd_front,
+  //and switches itself off once the frame is out
+void lcd_pump(uint8_t count){
+  while (pump_bank < LCD_BANKS){
+    if (pump_first[pump_bank] == SPAN_EMPTY || pump_x > pump_last[pump_bank]){
+      if (++pump_bank < LCD_BANKS){
+        pump_x = pump_first[pump_bank];
+      }
+      continue;
+    }
+
+    if (count-- == 0){
+      return;
+    }
+    if (pump_x == pump_first[pump_bank]){
+      lcd_position(pump_x, pump_bank);
+    }
+#if LCD_ASYNC
+    lcd_write(LCD_D, lcd_front[pump_bank * LCD_X + pump_x]);
+#endif
+    pump_x++;
+  }
+
+  TIMSK0 &= ~(1 << OCIE0A);
+  latency_flushed();
+}
+
+  //A full redraw for the menu screens, after any frame still being pumped
+void screen_show(void){
+  dirty_wait();
   show_screen();
-  _delay_ms(3000);
-  clear_screen();
+}
+
+//TIMER FUNCTIONS
+  //Timer 1 ticks (128 us) since power on. An overflow that happened but
+  //hasn't been serviced yet shows as TOV1 set with TCNT1 already wrapped.
+uint32_t clock_ticks(void){
+  uint8_t sreg = SREG;
+  cli();
+
+  uint16_t high = clock_high;
+  uint16_t low = TCNT1;
+  if ((TIFR1 & (1 << TOV1)) && low < 0x8000){
+    high++;
+  }
 
-  usb_connected = true;
+  SREG = sreg;
+  return ((uint32_t)high << 16) | low;
 }
 
-void send_debug_string(char string[]) {
-    char debugger[50];
-    sprintf(debugger, "[DBG @ %3.3f] ", get_system_time());
+  //125 ticks are 16 ms; split the division so the product can't overflow
+uint32_t clock_ms(uint32_t ticks){
+  return ticks / 125 * 16 + ticks % 125 * 16 / 125;
+}
 
-     // Send the debug preamble...
-     usb_serial_write(debugger, 15);
+void game_clock_reset(void){
+  game_clock_base = clock_ticks();
+  game_clock_stop = game_clock_base;
+  gametime = true;
+}
 
-     // Send all of the characters in the string
-     unsigned char char_count = 0;
-     while (*string != '\0') {
-         usb_serial_putchar(*string);
-         string++;
-         char_count++;
-     }
+void game_clock_pause(void){
+  if (gametime){
+    game_clock_stop = clock_ticks();
+    gametime = false;
+  }
+}
 
-     // Go to a new line (force this to be the start of the line)
-     usb_serial_putchar('\r');
-     usb_serial_putchar('\n');
- }
+void game_clock_resume(void){
+  if (!gametime){
+    game_clock_base += clock_ticks() - game_clock_stop;
+    gametime = true;
+  }
+}
+
+uint32_t game_clock_ms(void){
+  uint32_t now = gametime ? clock_ticks() : game_clock_stop;
+  return clock_ms(now - game_clock_base);
+}
+
+//DEBUGGER FUNCTIONS
+  //Waits for a USB host to open the port, then shows the controls for
+  //DEBUGGER_HOLD_MS before the intro
+void check_debugger(){
+  if (scene_enter()){
+    clear_screen();
+    draw_centred_P(17, PSTR("Waiting for"));
+    draw_centred_P(24, PSTR("debugger..."));
+    screen_show();
+    send_debug_string(PSTR("Waiting for usb connection..."));
+  }
+
+  if (!usb_connected){
+    if (usb_configured() && usb_serial_get_control()){
+      clear_screen();
+
+      //Teensy is successfully connected
+      draw_centred_P(17, PSTR("USB connected."));
+      send_debug_string(PSTR("The usb has been connected."));
+      send_debug_string(PSTR("Use W to move up."));
+      send_debug_string(PSTR("Use A to move left."));
+      send_debug_string(PSTR("Use S to move down."));
+      send_debug_string(PSTR("Use D to move right."));
+      send_debug_string(PSTR("Use K to shoot."));
+      screen_show();
+
+      usb_connected = true;
+      scene_since = clock_ticks();
+    }
+  }
+  else if (scene_ms() >= DEBUGGER_HOLD_MS){
+    clear_screen();
+    scene_set(SCENE_INTRO);
+  }
+}
+
+void send_debug_string(const char* string) {
+    // The string must outlive the record, so pass PSTR() literals
+    log_push(LOG_MESSAGE, string, 0, 0);
+}
 
  void send_line(char* string) {
      // Send all of the characters in the string
@@ -1205,7 +2078,546 @@ void send_debug_string(char string[]) {
      usb_serial_putchar('\n');
  }
 
+//TICK FUNCTIONS
+  //Sleeps until the next simulation tick. Ticks that passed while the last
+  //frame was still running are counted as overruns and skipped.
+void tick_wait(void){
+  cli();
+  while (ticks_pending == 0){
+    sleep_enable();
+    sei();
+    sleep_cpu(); //sei takes effect after this, so a tick can't slip in between
+    sleep_disable();
+    cli();
+  }
+
+  uint8_t skipped = ticks_pending - 1;
+  ticks_pending = 0;
+  sei();
+
+  if (skipped){
+    frame_overruns += skipped;
+    log_push(LOG_OVERRUN, 0, skipped > 127 ? 127 : skipped, frame_overruns);
+  }
+}
+
+//WHEEL FUNCTIONS
+void wheel_reset(void){
+  wheel_now = 0;
+  memset(wheel_head, WHEEL_NONE, sizeof(wheel_head));
+  memset(wheel_slot, WHEEL_NONE, sizeof(wheel_slot));
+}
+
+  //Runs the event the given number of frames from now (at least one, at most
+  //WHEEL_MAX), replacing any time it was already due
+void wheel_schedule(uint8_t event, uint16_t frames){
+  wheel_cancel(event);
+  if (frames < 1){
+    frames = 1;
+  }
+  if (frames > WHEEL_MAX){
+    frames = WHEEL_MAX;
+  }
+  wheel_due[event] = wheel_now + frames;
+  wheel_link(event);
+}
+
+void wheel_cancel(uint8_t event){
+  uint8_t slot = wheel_slot[event];
+  if (slot == WHEEL_NONE){
+    return;
+  }
+
+  uint8_t* link = &wheel_head[slot];
+  while (*link != event){
+    link = &wheel_next[*link];
+  }
+  *link = wheel_next[event];
+  wheel_slot[event] = WHEEL_NONE;
+}
+
+  //Within WHEEL_SLOTS frames an event goes in its frame's slot, otherwise in
+  //its block's. A delay of a whole lap of level 1 lands in the block slot
+  //that was just moved down, which comes round again in time.
+void wheel_link(uint8_t event){
+  uint16_t due = wheel_due[event];
+  uint8_t slot;
+  if ((uint16_t)(due - wheel_now) < WHEEL_SLOTS){
+    slot = due & WHEEL_MASK;
+  }
+  else {
+    slot = WHEEL_SLOTS + ((due >> WHEEL_BITS) & WHEEL_MASK);
+  }
+  wheel_next[event] = wheel_head[slot];
+  wheel_head[slot] = event;
+  wheel_slot[event] = slot;
+}
+
+  //Advances one frame. Events are unlinked before they run, so they can
+  //schedule themselves, or any other event, again.
+void wheel_tick(void){
+  uint8_t event;
+  wheel_now++;
+
+  if ((wheel_now & WHEEL_MASK) == 0){
+    uint8_t block = WHEEL_SLOTS + ((wheel_now >> WHEEL_BITS) & WHEEL_MASK);
+    while ((event = wheel_head[block]) != WHEEL_NONE){
+      wheel_head[block] = wheel_next[event];
+      wheel_link(event);
+    }
+  }
+
+  uint8_t slot = wheel_now & WHEEL_MASK;
+  while ((event = wheel_head[slot]) != WHEEL_NONE){
+    wheel_head[slot] = wheel_next[event];
+    wheel_slot[event] = WHEEL_NONE;
+    wheel_fire(event);
+  }
+}
+
+void wheel_fire(uint8_t event){
+  if (BENCH_WHEEL(event)){
+    return;
+  }
+
+  if (event < WHEEL_ALIEN + MAX_A){
+    alien_launch(event - WHEEL_ALIEN);
+  }
+  else if (event == WHEEL_MOTHERSHIP){
+    mothership_launch();
+  }
+  else if (event == WHEEL_MS_MISSILE){
+    msMissile_fire();
+  }
+  else if (event == WHEEL_SHIP_INFO){
+    ship_info(FIX_INT(ship.x), FIX_INT(ship.y), direction);
+    wheel_schedule(WHEEL_SHIP_INFO, SHIP_INFO_FRAMES);
+  }
+  else if (event == WHEEL_CLOCK){
+    hud_clock();
+  }
+}
+
+//RANDOM FUNCTIONS
+  //Streams start from the seed mixed with their index, never from zero
+  //(the one state xorshift can't leave)
+void rng_seed(uint16_t seed){
+  for (uint8_t i = 0; i < RNG_STREAMS; i++){
+    uint16_t state = seed ^ (0x9E37 * (i + 1));
+    rng_state[i] = state ? state : 1;
+    rng_next(i);
+  }
+}
+
+  //xorshift16 (7, 9, 8): period 65535, shifts and XORs only
+uint16_t rng_next(uint8_t stream){
+  uint16_t x = rng_state[stream];
+  x ^= x << 7;
+  x ^= x >> 9;
+  x ^= x << 8;
+  rng_state[stream] = x;
+  return x;
+}
+
+  //Uniform in [0, n) by scaling rather than modulo
+uint16_t rng_below(uint8_t stream, uint16_t n){
+  return ((uint32_t)rng_next(stream) * n) >> 16;
+}
 
+  //Frames until an event that averages one per mean frames: uniform in
+  //[1, 2 * mean - 1], drawn once instead of rolling every frame
+uint16_t rng_delay(uint8_t stream, uint16_t mean){
+  return 1 + rng_below(stream, 2 * mean - 1);
+}
+
+//INPUT FUNCTIONS
+  //A button counts this frame if it is held now or was pressed since the
+  //last frame; every pending serial byte is read, not just the first
+void input_sample(void){
+  uint8_t sreg = SREG;
+  cli();
+
+  input_scan();
+  uint8_t buttons = button_state;
+  while (input_tail != input_head){
+    uint8_t event = input_queue[input_tail];
+    if (event & INPUT_PRESS){
+      buttons |= event & ~INPUT_PRESS;
+    }
+    input_tail = (input_tail + 1) & (INPUT_QUEUE - 1);
+  }
+
+  latency_take();
+  SREG = sreg;
+
+  uint8_t keys = 0;
+  for (uint8_t n = 0; n < INPUT_SERIAL_MAX && usb_serial_available(); n++){
+    keys |= input_key_buttons(usb_serial_getchar());
+  }
+  if (keys){
+    latency_key();
+  }
+  buttons |= keys;
+
+  input.buttons = buttons;
+  input.key = 0;
+  input.adc = adc_read();
+
+#if RECORD_INPUT
+  uint8_t record[INPUT_RECORD_MAX] = {0};
+  input_encode(&input, record);
+  log_push(LOG_INPUT, 0, record[0] | (record[1] << 8), record[2]);
+#endif
+}
+
+uint8_t input_pins(void){
+  uint8_t pins = 0;
+  if ((PIND>>1) & 0b1) pins |= BUTTON_UP;
+  if ((PIND>>0) & 0b1) pins |= BUTTON_RIGHT;
+  if ((PINB>>7) & 0b1) pins |= BUTTON_DOWN;
+  if ((PINB>>1) & 0b1) pins |= BUTTON_LEFT;
+  if ((PINF>>5) & 0b1) pins |= BUTTON_FIRE;
+  return pins;
+}
+
+  //Called with interrupts off. A button whose pin differs from its debounced
+  //level changes at once, unless it already changed within INPUT_DEBOUNCE;
+  //bounces inside that window are picked up by the next scan after it.
+void input_scan(void){
+  uint8_t changed = input_pins() ^ button_state;
+  uint16_t now = TCNT1;
+
+  for (uint8_t b = 0; changed; b++, changed >>= 1){
+    if (!(changed & 0b1) || (uint16_t)(now - button_edge[b]) < INPUT_DEBOUNCE){
+      continue;
+    }
+
+    uint8_t bit = 1 << b;
+    button_state ^= bit;
+    button_edge[b] = now;
+
+    if (button_state & bit){
+      latency_press();
+    }
+
+    uint8_t next = (input_head + 1) & (INPUT_QUEUE - 1);
+    if (next != input_tail){
+      input_queue[input_head] = bit | ((button_state & bit) ? INPUT_PRESS : 0);
+      input_head = next;
+    }
+  }
+}
+
+uint8_t input_key_buttons(int16_t key){
+  for (uint8_t b = 0; b < INPUT_BUTTONS; b++){
+    if (key == pgm_read_byte(&input_keys[b])){
+      return 1 << b;
+    }
+  }
+  return 0;
+}
+
+  //Seeds the random streams and, when recording, starts the trace with the seed
+void input_seed(uint16_t seed){
+  rng_seed(seed);
+#if RECORD_INPUT
+  log_push(LOG_SEED, 0, seed, 0);
+#endif
+}
+
+uint8_t input_encode(const Input* in, uint8_t record[]){
+  uint16_t word = (in->adc & INPUT_ADC_MASK) | ((uint16_t)in->buttons << INPUT_BUTTON_SHIFT);
+  if (in->key){
+    word |= INPUT_KEY_FLAG;
+  }
+
+  record[0] = word;
+  record[1] = word >> 8;
+  if (in->key){
+    record[2] = in->key;
+    return 3;
+  }
+  return 2;
+}
+
+uint8_t input_decode(const uint8_t record[], Input* in){
+  uint16_t word = record[0] | ((uint16_t)record[1] << 8);
+  in->adc = word & INPUT_ADC_MASK;
+  in->buttons = (word >> INPUT_BUTTON_SHIFT) & 0x1F;
+  if (word & INPUT_KEY_FLAG){
+    in->key = record[2];
+    return 3;
+  }
+  in->key = 0;
+  return 2;
+}
+
+//LOG FUNCTIONS
+void log_push(uint8_t kind, const char* text, int x, int y){
+  uint8_t sreg = SREG;
+  cli();
+
+  uint8_t next = (log_head + 1) & (LOG_SIZE - 1);
+  if (next == log_tail){
+    log_dropped++;
+  }
+  else {
+    LogRecord* record = &log_ring[log_head];
+    record->ticks = clock_ticks();
+    record->text = text;
+    record->x = x;
+    record->y = y;
+    record->kind = kind;
+    log_head = next;
+  }
+
+  SREG = sreg;
+}
+
+uint8_t log_format(LogRecord* record, char* line){
+  STACK_PROBE(STACK_LOG);
+
+  //Trace lines carry the record bytes in hex, unadorned for easy parsing
+  if (record->kind == LOG_INPUT){
+    uint16_t word = record->x;
+    if (word & INPUT_KEY_FLAG){
+      return sprintf_P(line, PSTR(">%02x%02x%02x\r\n"), word & 0xFF, word >> 8, (uint8_t)record->y);
+    }
+    return sprintf_P(line, PSTR(">%02x%02x\r\n"), word & 0xFF, word >> 8);
+  }
+  else if (record->kind == LOG_SEED){
+    return sprintf_P(line, PSTR("@%04x\r\n"), (uint16_t)record->x);
+  }
+  else if (record->kind == LOG_PROFILE){
+    //Zone, then min, max, mean and count in Timer 3 counts
+    Profile* p = &profile_sent[record->x];
+    return sprintf_P(line, PSTR("%%%x%04x%04x%04x%04x\r\n"), record->x, p->min, p->max, (uint16_t)(p->total / p->count), p->count);
+  }
+
+  uint32_t ms = clock_ms(record->ticks);
+  int length = sprintf_P(line, PSTR("[DBG @ %lu.%03u] "), (unsigned long)(ms / 1000), (unsigned)(ms % 1000));
+
+  if (record->kind == LOG_SHIP){
+    length += sprintf_P(line + length, PSTR("The ship is now at (%d, %d), and aiming %s.\r\n"), record->x, record->y, record->text);
+  }
+  else if (record->kind == LOG_STACK){
+    length += sprintf_P(line + length, PSTR("Stack in "));
+    strcpy_P(line + length, record->text);
+    length += strlen(line + length);
+    length += sprintf_P(line + length, PSTR(" reached %u bytes.\r\n"), (uint16_t)record->x);
+  }
+  else if (record->kind == LOG_LATENCY){
+    uint16_t from = record->x * LATENCY_BIN_MS;
+    if (record->x == LATENCY_BINS - 1){
+      length += sprintf_P(line + length, PSTR("Input to LCD %u+ ms: %u.\r\n"), from, (uint16_t)record->y);
+    }
+    else {
+      length += sprintf_P(line + length, PSTR("Input to LCD %u-%u ms: %u.\r\n"), from, from + LATENCY_BIN_MS - 1, (uint16_t)record->y);
+    }
+  }
+  else if (record->kind == LOG_RESTART){
+    length += sprintf_P(line + length, PSTR("Restart to first frame: %u ms.\r\n"), (uint16_t)record->x);
+  }
+  else if (record->kind == LOG_MEMORY){
+    length += sprintf_P(line + length, PSTR("SRAM free: %u bytes now, %u at worst.\r\n"), (uint16_t)record->x, (uint16_t)record->y);
+  }
+  else if (record->kind == LOG_OVERRUN){
+    length += sprintf_P(line + length, PSTR("Frame overrun, %d tick(s) skipped (%u total).\r\n"), record->x, (uint16_t)record->y);
+  }
+  else {
+    strcpy_P(line + length, record->text);
+    length += strlen(line + length);
+    line[length++] = '\r';
+    line[length++] = '\n';
+    line[length] = '\0';
+  }
+  return length;
+}
+
+  //Bytes go out with usb_serial_putchar_nowait(), so a host that holds DTR
+  //but stops reading never stalls the frame. Only accepted bytes count as
+  //sent; the rest of the line waits for the next frame, and records that
+  //don't fit in the ring meanwhile show up in log_dropped.
+void log_drain(void){
+  //Nothing is lost while the host isn't listening; the ring just fills
+  if (!usb_configured() || !(usb_serial_get_control() & USB_SERIAL_DTR)){
+    return;
+  }
+
+  uint8_t budget = LOG_BYTES_PER_FRAME;
+  while (budget > 0){
+    if (log_sent == log_length){
+      if (log_dropped){
+        uint8_t sreg = SREG;
+        cli();
+        uint8_t dropped = log_dropped;
+        log_dropped = 0;
+        SREG = sreg;
+        log_length = sprintf_P(log_line, PSTR("[DBG] %u records dropped.\r\n"), dropped);
+      }
+      else if (log_tail != log_head){
+        log_length = log_format(&log_ring[log_tail], log_line);
+        log_tail = (log_tail + 1) & (LOG_SIZE - 1);
+      }
+      else {
+        return;
+      }
+      log_sent = 0;
+    }
+
+    if (usb_serial_putchar_nowait(log_line[log_sent]) != 0){
+      return; //Transmit buffer full; try again next frame
+    }
+    log_sent++;
+    budget--;
+  }
+}
+
+//STACK FUNCTIONS
+  //Paint bytes never overwritten since reset, counted up from the end of .bss
+uint16_t stack_unused(void){
+#if STACK_CHECK && !defined(HOST_BUILD)
+  const uint8_t* p = &_end;
+  while (p <= &__stack && *p == STACK_CANARY){
+    p++;
+  }
+  return p - &_end;
+#else
+  return 0;
+#endif
+}
+
+  //Every STACK_REPORT_FRAMES, logs the free SRAM and any probe site whose
+  //depth grew since it was last reported
+void stack_report(void){
+#if STACK_CHECK
+  if (++stack_frames < STACK_REPORT_FRAMES){
+    return;
+  }
+  stack_frames = 0;
+
+  for (uint8_t site = 0; site < STACK_SITES; site++){
+    uint8_t sreg = SREG;
+    cli();
+    uint16_t depth = stack_deepest[site];
+    SREG = sreg;
+
+    if (depth > stack_reported[site]){
+      stack_reported[site] = depth;
+      log_push(LOG_STACK, (const char*)pgm_read_ptr(&stack_name[site]), depth, 0);
+    }
+  }
+
+#ifndef HOST_BUILD
+  //No painted SRAM on the host; it reports the probe depths only
+  log_push(LOG_MEMORY, 0, SP - (uint16_t)&_end, stack_unused());
+#endif
+#endif
+}
+
+//LATENCY FUNCTIONS
+  //Called with interrupts off, when a button goes down
+void latency_press(void){
+#if LATENCY_CHECK
+  if (!latency_armed){
+    latency_input = clock_ticks();
+    latency_armed = true;
+  }
+#endif
+}
+
+  //Called with interrupts off, as the frame samples its input. A press
+  //arriving while the previous frame's is still on its way waits its turn.
+void latency_take(void){
+#if LATENCY_CHECK
+  if (latency_armed && !latency_carried){
+    latency_frame = latency_input;
+    latency_carried = true;
+    latency_armed = false;
+  }
+#endif
+}
+
+  //USB doesn't say when a key arrived, so a key counts from when it's read
+void latency_key(void){
+#if LATENCY_CHECK
+  uint8_t sreg = SREG;
+  cli();
+  if (!latency_carried){
+    latency_frame = clock_ticks();
+    latency_carried = true;
+  }
+  SREG = sreg;
+#endif
+}
+
+void latency_flushed(void){
+#if LATENCY_CHECK
+  if (!latency_carried){
+    return;
+  }
+  latency_carried = false;
+
+  uint32_t bin = clock_ms(clock_ticks() - latency_frame) / LATENCY_BIN_MS;
+  if (bin >= LATENCY_BINS){
+    bin = LATENCY_BINS - 1;
+  }
+  if (latency_hist[bin] < UINT16_MAX){
+    latency_hist[bin]++;
+  }
+#endif
+}
+
+  //Every LATENCY_REPORT_FRAMES, starts logging the histogram one non-empty
+  //bin per frame, so a report never floods the log ring
+void latency_report(void){
+#if LATENCY_CHECK
+  if (++latency_frames >= LATENCY_REPORT_FRAMES){
+    latency_frames = 0;
+    latency_next = 0;
+  }
+
+  while (latency_next < LATENCY_BINS){
+    uint8_t bin = latency_next++;
+    if (latency_hist[bin]){
+      log_push(LOG_LATENCY, 0, bin, latency_hist[bin]);
+      return;
+    }
+  }
+#endif
+}
+
+//PROFILE FUNCTIONS
+void profile_add(uint8_t zone, uint16_t counts){
+  Profile* p = &profile[zone];
+  if (p->count == 0 || counts < p->min){
+    p->min = counts;
+  }
+  if (counts > p->max){
+    p->max = counts;
+  }
+  p->total += counts;
+  p->count++;
+}
+
+  //Every PROFILE_REPORT_FRAMES, queues a line per zone timed since the last
+  //report and starts the zones afresh
+void profile_report(void){
+#if PROFILE
+  if (++profile_frames < PROFILE_REPORT_FRAMES){
+    return;
+  }
+  profile_frames = 0;
+
+  memcpy(profile_sent, profile, sizeof(profile));
+  memset(profile, 0, sizeof(profile));
+  for (uint8_t zone = 0; zone < PROFILE_ZONES; zone++){
+    if (profile_sent[zone].count){
+      log_push(LOG_PROFILE, 0, zone, 0);
+    }
+  }
+#endif
+}
 
 //HELPER FUNCTIONS
 void draw_centred(unsigned char y, char* string) {
@@ -1219,20 +2631,83 @@ void draw_centred(unsigned char y, char* string) {
     draw_string((x > 0) ? x : 0, y, string);
 }
 
+void draw_centred_P(unsigned char y, const char* string) {
+    // As draw_centred(), for a string in flash
+    char x = 42-(strlen_P(string)*5/2);
+    draw_string_P((x > 0) ? x : 0, y, string);
+}
+
+void draw_string_P(unsigned char x, unsigned char y, const char* string) {
+    // Draw a string from flash one character at a time
+    char c;
+    while ((c = pgm_read_byte(string++)) != '\0') {
+        draw_char(x, y, c);
+        x += 5;
+    }
+}
+
 /*
 * Interrupt service routines
 */
 ISR(TIMER1_OVF_vect) {
-    ovf_count++;
-    overflow++;
+    clock_high++;
 }
 
-ISR(TIMER0_OVF_vect) {
-  if (gametime == true){
-    debugCounter++;
-    if (debugCounter == 15){
-      ship_info(ship.x, ship.y, direction);
-      debugCounter = 0;
-    }
+ISR(TIMER1_COMPA_vect) {
+  STACK_PROBE(STACK_ISR);
+
+  uint16_t period = TICK_WHOLE;
+  tick_carry += TICK_REM;
+  if (tick_carry >= TICK_DIV){
+    tick_carry -= TICK_DIV;
+    period++;
+  }
+  OCR1A += period;
+
+  if (ticks_pending < 255){
+    ticks_pending++;
+  }
+}
+
+ISR(ADC_vect) {
+  STACK_PROBE(STACK_ISR);
+
+  adc_sum += ADC;
+  if (++adc_samples < (1 << ADC_OVERSAMPLE)){
+    return;
   }
+
+  uint16_t reading = adc_sum >> ADC_OVERSAMPLE;
+  adc_sum = 0;
+  adc_samples = 0;
+
+  //adc_state holds the filtered value scaled by 2^ADC_FILTER
+  adc_state += reading - (adc_state >> ADC_FILTER);
+  adc_filtered = adc_state >> ADC_FILTER;
+}
+
+ISR(INT0_vect) {
+  STACK_PROBE(STACK_ISR);
+  input_scan();
+}
+
+ISR(INT1_vect) {
+  STACK_PROBE(STACK_ISR);
+  input_scan();
+}
+
+ISR(PCINT0_vect) {
+  STACK_PROBE(STACK_ISR);
+  input_scan();
+}
+
+ISR(TIMER0_COMPA_vect) {
+  STACK_PROBE(STACK_ISR);
+  OCR0A += LCD_PUMP_PERIOD;
+  lcd_pump(LCD_PUMP_BYTES);
+}
+
+ISR(TIMER0_OVF_vect) {
+  STACK_PROBE(STACK_ISR);
+  input_scan();
 }
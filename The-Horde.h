@@ -0,0 +1,370 @@
+#ifndef THE_HORDE_H
+#define THE_HORDE_H
+
+//Types, build options and entry points shared by The-Horde.c and the host
+//bench (host/bench.c), so the bench reads the game's own layouts.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/pgmspace.h>
+
+#include "sprite.h"
+
+//Build options
+#ifndef MAX_A
+#define MAX_A 5   //Aliens in a wave
+#endif
+
+  //Narrow phase: once hitboxes overlap, AND the sprite images row by row so
+  //only pixels that overlap on screen count as a hit. 0 uses hitboxes alone.
+#ifndef PIXEL_COLLISION
+#define PIXEL_COLLISION 1
+#endif
+
+  //Broad phase: visible aliens are binned by their top left pixel into a
+  //uniform grid, so a query only tests the aliens in the cells its hitbox
+  //can reach. Set BROAD_PHASE to 0 to test every alien (for comparison).
+#ifndef BROAD_PHASE
+#define BROAD_PHASE 1
+#endif
+
+  //Homing: set HOMING to 1 and attacking aliens and the mothership re-aim
+  //every frame by reading the flow field (see flow_aim()). 0 keeps the old
+  //attacks, which aim once and then fly straight until they reach a wall.
+#ifndef HOMING
+#define HOMING 0
+#endif
+
+  //Set RECORD_INPUT to 1 to stream the seed and every frame's input over the
+  //USB log ('@' and '>' lines), for replay with the host bench.
+#ifndef RECORD_INPUT
+#define RECORD_INPUT 0
+#endif
+
+  //LCD pump: send the frame from a second buffer, from the Timer 0 compare
+  //A interrupt. 0 sends each frame synchronously.
+#ifndef LCD_ASYNC
+#define LCD_ASYNC 1
+#endif
+
+  //Stack canary and probes; 0 drops both
+#ifndef STACK_CHECK
+#define STACK_CHECK 1
+#endif
+
+  //Input-to-LCD latency histogram
+#ifndef LATENCY_CHECK
+#define LATENCY_CHECK 0
+#endif
+
+  //Timer 3 zone timings
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+//Fixed-point kinematics
+  //Positions and velocities are Q8.8: 8 integer bits and 8 fractional bits,
+  //so sprites move with integer adds instead of soft-float doubles.
+typedef int16_t fixed;
+
+#define FIX_SHIFT 8
+#define FIX_ONE (1 << FIX_SHIFT)
+#define FIX(n) ((fixed)((n) * FIX_ONE))              //Constant to fixed
+#define FIX_INT(f) ((f) >> FIX_SHIFT)                 //Truncate to a pixel
+#define FIX_ROUND(f) (((f) + FIX_ONE / 2) >> FIX_SHIFT) //Round to a pixel
+
+//Integer trigonometry
+  //Angles are binary: 256 to the turn, 0 along +x and 64 along +y (down the
+  //screen), so they wrap for free in a uint8_t. Sines are Q2.14.
+#define TRIG_ONE 16384
+#define TRIG_SHIFT 14
+#define ANGLE_QUARTER 64
+
+  //The library Sprite holds the size, bitmap and visibility; the position
+  //is the fixed fields, and the Sprite's doubles are never updated
+typedef struct Entity {
+  Sprite sprite;
+  fixed x, y;
+  fixed dx, dy;
+  uint8_t type;      //Index into hitbox[]
+} Entity;
+
+//Collision
+  //Entity types, each with a hitbox measured from the sprite's top left
+#define TYPE_SHIP 0
+#define TYPE_ALIEN 1
+#define TYPE_MISSILE 2
+#define TYPE_MOTHERSHIP 3
+#define TYPE_MSMISSILE 4
+#define TYPE_TURRET 5
+#define TYPES 6
+
+typedef struct Hitbox {
+  uint8_t w, h;
+} Hitbox;
+
+//Entity pools
+  //Live slots sit densely at the front of slot[] and free slots behind them,
+  //so acquire and release are O(1) and loops visit only live entities.
+  //A live entity is always visible; a free one is always hidden.
+typedef struct Pool {
+  Entity* entity;  //Storage, capacity entries
+  uint8_t* slot;   //[0, count) live, [count, capacity) free
+  uint8_t* where;  //Position of each entity's slot within slot[]
+  uint8_t capacity;
+  uint8_t count;
+} Pool;
+
+#define POOL_GET(pool, k) (&(pool).entity[(pool).slot[k]])
+
+//Frame input
+  //Everything process() reads from the outside world, sampled once at the
+  //top of the frame so a session can be recorded and replayed exactly.
+#define BUTTON_UP 0x01
+#define BUTTON_RIGHT 0x02
+#define BUTTON_DOWN 0x04
+#define BUTTON_LEFT 0x08
+#define BUTTON_FIRE 0x10
+
+typedef struct Input {
+  uint8_t buttons;
+  char key;      //Serial key this frame, 0 if none (keys are folded into
+                 //buttons now; kept so older traces still replay)
+  uint16_t adc;  //Filtered potentiometer reading
+} Input;
+
+  //A recorded frame is a little-endian word (ADC in bits 0-9, buttons in
+  //10-14, bit 15 set when a key byte follows): two bytes, three with a key.
+#define INPUT_RECORD_MAX 3
+#define INPUT_ADC_MASK 0x03FF
+#define INPUT_BUTTON_SHIFT 10
+#define INPUT_KEY_FLAG 0x8000
+
+//Debug log
+  //Records are queued by ISRs and game code and formatted into text only
+  //when the main loop drains them to USB.
+#define LOG_MESSAGE 0
+#define LOG_SHIP 1
+#define LOG_OVERRUN 2
+#define LOG_INPUT 3
+#define LOG_SEED 4
+#define LOG_STACK 5
+#define LOG_MEMORY 6
+#define LOG_RESTART 7
+#define LOG_LATENCY 8
+#define LOG_PROFILE 9
+
+typedef struct LogRecord {
+  uint32_t ticks;    //clock_ticks() when queued
+  const char* text;  //Message or probe site name (in flash), or the ship's direction
+  int16_t x, y;      //Ship position (LOG_SHIP), ticks skipped and running
+                     //total (LOG_OVERRUN), record word and key (LOG_INPUT),
+                     //seed (LOG_SEED), stack depth (LOG_STACK), SRAM free
+                     //now and at worst (LOG_MEMORY), milliseconds
+                     //(LOG_RESTART), latency bin and count (LOG_LATENCY),
+                     //zone (LOG_PROFILE)
+  uint8_t kind;
+} LogRecord;
+
+//Profiler zone timings, in Timer 3 counts
+typedef struct Profile {
+  uint16_t min, max;
+  uint32_t total;
+  uint16_t count;
+} Profile;
+
+//Scenes of the main loop
+#define SCENE_DEBUGGER 0
+#define SCENE_INTRO 1
+#define SCENE_COUNTDOWN 2
+#define SCENE_PLAY 3
+#define SCENE_GAME_OVER 4
+
+//Stack probe sites
+#define STACK_MAIN 0
+#define STACK_PROCESS 1
+#define STACK_COLLISION 2
+#define STACK_STATUS 3
+#define STACK_LOG 4
+#define STACK_ISR 5
+#define STACK_SITES 6
+
+//Latency histogram
+#define LATENCY_BIN_MS 10
+#define LATENCY_BINS 16 //The last bin also holds everything slower
+
+//Profiler zones
+#define PROFILE_INPUT 0
+#define PROFILE_ALIENS 1
+#define PROFILE_MOTHERSHIP 2 //And its missiles
+#define PROFILE_MISSILES 3   //Player missiles and the potentiometer
+#define PROFILE_COLLISION 4
+#define PROFILE_RENDER 5     //Includes status_display and the LCD flush
+#define PROFILE_STATUS 6
+#define PROFILE_ZONES 7
+
+//Timer wheel geometry and event ids (see wheel_tick())
+#define WHEEL_BITS 5
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_MAX (WHEEL_SLOTS * WHEEL_SLOTS - 1) //Longest delay in frames
+#define WHEEL_NONE 0xFF
+
+  //One per alien, then the periodic jobs
+#define WHEEL_ALIEN 0
+#define WHEEL_MOTHERSHIP MAX_A
+#define WHEEL_MS_MISSILE (MAX_A + 1)
+#define WHEEL_SHIP_INFO (MAX_A + 2)
+#define WHEEL_CLOCK (MAX_A + 3)
+#define WHEEL_EVENTS (MAX_A + 4)
+
+//State the host bench reads
+extern volatile int score;
+extern volatile int lives;
+extern volatile uint16_t frame_overruns;
+extern uint8_t scene;
+extern bool restart_pending;
+extern uint16_t restart_ms;
+extern Entity ship;
+extern Input input;
+extern volatile uint16_t stack_deepest[STACK_SITES];
+extern const char* const stack_name[STACK_SITES] PROGMEM;
+extern uint16_t latency_hist[LATENCY_BINS];
+extern uint16_t wheel_now;
+
+//Function declarations
+void init_hardware(void);
+void init_adc(void);
+uint16_t adc_read(void);
+
+void intro_screen(void);
+void countdown(void);
+void border(void);
+void status_display(void);
+void hud_init(void);
+void hud_number(uint8_t slot, uint8_t width, int value, bool pad);
+void hud_clock(void);
+
+void dirty_mark(int x, int y, int w, int h);
+void dirty_all(void);
+void dirty_flush(void);
+void dirty_wait(void);
+void lcd_pump(uint8_t count);
+void screen_show(void);
+
+void ship_setup(void);
+void alien_setup(void);
+void missile_setup(void);
+void missile_fire(void);
+void mothership_setup(void);
+void msMissile_setup(void);
+void turret_setup(void);
+void turret_calc(void);
+
+void process(void);
+void tick_wait(void);
+void alien_attack(Entity* alien);
+void alien_spawn(Entity* alien);
+void mothership_attack(Entity* mothership);
+void msMissile_attack(Entity* msMissile);
+void alien_idle(uint8_t i);
+void alien_launch(uint8_t i);
+void mothership_idle(void);
+void mothership_launch(void);
+void msMissile_fire(void);
+
+void pool_clear(Pool* pool);
+Entity* pool_acquire(Pool* pool);
+void pool_release(Pool* pool, Entity* entity);
+
+void collision_checker(void);
+bool collision(Entity* a, Entity* b);
+bool collision_pixels(Entity* a, Entity* b);
+int collision_height(Entity* e);
+uint8_t collision_row(Entity* e, int row);
+int grid_clamp(int value, int limit);
+void grid_build(void);
+uint8_t grid_query(Entity* entity, uint8_t found[]);
+
+void flow_update(void);
+void flow_aim(Entity* sprite, fixed speed);
+
+void scene_step(void);
+void scene_set(uint8_t next);
+bool scene_enter(void);
+uint16_t scene_ms(void);
+bool scene_button(void);
+
+void game_start(uint16_t seed);
+void game_end(void);
+void game_over_screen(void);
+
+void sprite_init(Entity* sprite, int x, int y, unsigned char width, unsigned char height, const unsigned char image[]);
+void sprite_draw(Entity* sprite);
+void sprite_turn_to(Entity* sprite, fixed dx, fixed dy);
+bool sprite_step(Entity* sprite);
+bool sprite_show(Entity* sprite);
+bool sprite_hide(Entity* sprite);
+bool sprite_move_to(Entity* sprite, fixed x, fixed y);
+void sprite_set_image(Entity* sprite, const unsigned char image[]);
+void sprite_turn(Entity* sprite, uint8_t angle);
+void sprite_aim(Entity* sprite, uint8_t angle, fixed speed);
+void sprite_aim_at(Entity* sprite, fixed x, fixed y, fixed speed);
+
+int16_t trig_sin(uint8_t angle);
+int16_t trig_cos(uint8_t angle);
+uint8_t trig_atan2(int16_t dy, int16_t dx);
+
+uint32_t clock_ticks(void);
+uint32_t clock_ms(uint32_t ticks);
+void game_clock_reset(void);
+void game_clock_pause(void);
+void game_clock_resume(void);
+uint32_t game_clock_ms(void);
+
+void rng_seed(uint16_t seed);
+uint16_t rng_next(uint8_t stream);
+uint16_t rng_below(uint8_t stream, uint16_t n);
+uint16_t rng_delay(uint8_t stream, uint16_t mean);
+
+void wheel_reset(void);
+void wheel_schedule(uint8_t event, uint16_t frames);
+void wheel_cancel(uint8_t event);
+void wheel_link(uint8_t event);
+void wheel_tick(void);
+void wheel_fire(uint8_t event);
+
+void check_debugger(void);
+void ship_info(int x_pos, int y_pos, char* direction);
+
+void draw_centred(unsigned char y, char* string);
+void draw_centred_P(unsigned char y, const char* string);
+void draw_string_P(unsigned char x, unsigned char y, const char* string);
+void send_line(char* string);
+void send_debug_string(const char* string);
+
+void input_sample(void);
+uint8_t input_pins(void);
+void input_scan(void);
+uint8_t input_key_buttons(int16_t key);
+void input_seed(uint16_t seed);
+uint8_t input_encode(const Input* in, uint8_t record[]);
+uint8_t input_decode(const uint8_t record[], Input* in);
+
+void log_push(uint8_t kind, const char* text, int x, int y);
+uint8_t log_format(LogRecord* record, char* line);
+void log_drain(void);
+
+uint16_t stack_unused(void);
+void stack_report(void);
+
+void latency_press(void);
+void latency_take(void);
+void latency_key(void);
+void latency_flushed(void);
+void latency_report(void);
+
+void profile_add(uint8_t zone, uint16_t counts);
+void profile_report(void);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+//Host stand-in for <avr/interrupt.h>. Interrupt vectors become ordinary
+//functions that the host clock calls when a simulated timer overflows.
+
+#define ISR(vector) void vector(void)
+
+#define sei()
+#define cli()
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+//Host stand-in for <avr/io.h>. The ATmega32U4 registers the game touches are
+//plain variables here, so the host driver can script them frame by frame.
+
+#include <stdint.h>
+
+//Port registers
+extern volatile uint8_t PINB, PIND, PINF;
+extern volatile uint8_t DDRB, DDRD, DDRF;
+extern volatile uint8_t PORTB, PORTD, PORTF;
+
+//External and pin-change interrupts. Pin changes only raise their vectors
+//when the driver sets the pins through host_set_pins().
+extern volatile uint8_t EICRA, EIMSK;
+extern volatile uint8_t PCICR, PCMSK0;
+
+//Timers
+extern volatile uint8_t TCCR0A, TCCR0B, TIMSK0, TIFR0, TCNT0, OCR0A;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+//Overflows are serviced as soon as they happen, so TOV1 is never pending
+extern volatile uint8_t TIFR1;
+extern volatile uint16_t TCNT1, OCR1A;
+
+//Timer 3 (the profiler's) counts wall-clock nanoseconds on the host, so
+//zone times come out as host CPU time
+extern volatile uint8_t TCCR3A, TCCR3B;
+uint16_t host_tcnt3(void);
+#define TCNT3 host_tcnt3()
+
+//ADC
+extern volatile uint8_t ADMUX, ADCSRB;
+extern volatile uint16_t ADC;
+
+//Reading ADCSRA finishes a single conversion that has been started, so a
+//busy-wait on ADSC falls straight through with ADC holding the scripted value.
+//In free-running mode the host clock fires ADC_vect at the conversion rate.
+volatile uint8_t* host_adcsra(void);
+#define ADCSRA (*host_adcsra())
+
+//Clock prescaler
+extern volatile uint8_t CLKPR;
+
+//Status register (interrupt enable lives in bit 7)
+extern volatile uint8_t SREG;
+
+//Stack pointer: the host frame address, truncated to 16 bits. RAMEND is the
+//value the driver recorded at startup, so RAMEND - SP is the stack depth the
+//game has added below the driver (in host frame sizes, not AVR ones).
+extern uint16_t host_ramend;
+#define SP ((uint16_t)(uintptr_t)__builtin_frame_address(0))
+#define RAMEND host_ramend
+
+//Bit positions
+#define ISC00 0
+#define ISC10 2
+#define INT0 0
+#define INT1 1
+#define PCIE0 0
+#define PCINT1 1
+#define PCINT7 7
+
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define WGM02 3
+#define TOIE0 0
+#define OCIE0A 1
+#define OCF0A 1
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define TOIE1 0
+#define TOV1 0
+#define OCIE1A 1
+
+#define CS31 1
+
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+//Host stand-in for <avr/pgmspace.h>. There is one address space here, so
+//flash data is ordinary const data and the _P functions are the plain ones.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_ptr(address) (*(const void* const*)(address))
+
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define sprintf_P sprintf
+
+#endif
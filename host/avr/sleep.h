@@ -0,0 +1,16 @@
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+//Host stand-in for <avr/sleep.h>. Sleeping advances the simulated clock by
+//one timer count, so a sleep loop runs until the next interrupt fires.
+
+#define SLEEP_MODE_IDLE 0
+
+void host_sleep(void);
+
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu() host_sleep()
+
+#endif
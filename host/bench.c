@@ -0,0 +1,1044 @@
+//Frame-time benchmark for The-Horde.c on a desktop machine.
+//
+//Starts a game the way main() does, then calls process() once per frame
+//with scripted button, serial and potentiometer inputs, and reports the cost
+//per frame broken down by the phases process() marks.
+//
+//  bench [frames] [seed]
+//  bench record FILE [frames] [seed]
+//  bench replay FILE
+//  bench restart [games]
+//  bench input [frames]
+//  bench latency [presses] [lcd ns/byte]   (build with -DLATENCY_CHECK=1)
+//  bench flush [frames] [lcd ns/byte]
+//  bench profile CAPTURE [ns/count]
+//  bench usb FILE <any of the above>
+//  bench kinematics [steps]
+//  bench trig [calls]
+//  bench normalise [calls]
+//  bench flow [frames]
+//  bench wheel [frames] [seed]
+//  bench hud
+//
+//record saves the scripted session's inputs as a trace; replay feeds a trace
+//back through process(). Both print a hash of every frame, so a replay that
+//matches its recording prints the same hash. A capture from the game may
+//hold several games; each replays from its own seed. restart plays short games
+//through the scene loop and reports the time from the game over button to
+//the next game's first frame. input taps buttons between frames and sends
+//serial bursts, and counts how many reach the frame. latency presses a
+//button at random points in the frame and prints the game's own
+//input-to-LCD histogram, with each LCD byte costing simulated time. flush
+//runs frames back to back with simulated CPU time in each phase, and checks
+//that every frame reaches the LCD whole while the next one is being drawn.
+//usb saves everything the game sends over USB to FILE; in a -DPROFILE=1
+//build that includes the profiler's lines, which profile turns into a table.
+//wheel runs the timer wheel alone and checks that every event fires on its
+//frame. hud checks the cached HUD row against the library's own text.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+
+#include <avr/io.h>
+
+#include "graphics.h"
+#include "sprite.h"
+#include "usb_serial.h"
+#include "host.h"
+
+//The game's types, build options and entry points
+#include "../The-Horde.h"
+
+//The double-precision kinematics the fixed-point path replaced
+typedef struct Body {
+  double x, y;
+  double dx, dy;
+} Body;
+
+static bool body_step(Body* body){
+  int x0 = round(body->x);
+  int y0 = round(body->y);
+  body->x += body->dx;
+  body->y += body->dy;
+  int x1 = round(body->x);
+  int y1 = round(body->y);
+  return (x1 != x0) || (y1 != y0);
+}
+
+//Flies both paths at the alien, mothership and msMissile speeds in every
+//direction, reporting the worst pixel divergence and the cost per step.
+static int kinematics(unsigned long steps){
+  static const double speeds[] = {1.5, 0.75, 1.0};
+  static unsigned char image[1] = {0x80};
+
+  for (int s = 0; s < 3; s++){
+    int worst = 0;
+    for (int deg = 0; deg < 360; deg += 3){
+      double r = deg * M_PI / 180;
+      Body body = {42, 29, speeds[s] * cos(r), speeds[s] * sin(r)};
+      Entity entity;
+      sprite_init(&entity, 42, 29, 1, 1, image);
+      entity.dx = (int16_t)round(body.dx * 256);
+      entity.dy = (int16_t)round(body.dy * 256);
+
+      //Fly until the sprite leaves the screen, as the game hides it there
+      while (body.x >= 0 && body.x <= LCD_X && body.y >= 0 && body.y <= LCD_Y){
+        body_step(&body);
+        sprite_step(&entity);
+        int ex = abs((int)round(body.x) - ((entity.x + 128) >> 8));
+        int ey = abs((int)round(body.y) - ((entity.y + 128) >> 8));
+        if (ex > worst) worst = ex;
+        if (ey > worst) worst = ey;
+      }
+    }
+    printf("speed %.2f px/frame: max divergence %d px on screen\n", speeds[s], worst);
+  }
+
+  //Step a small population so the loop isn't a single dependency chain
+  Body bodies[8];
+  Entity entities[8];
+  for (int i = 0; i < 8; i++){
+    bodies[i] = (Body){10, 20, 0.01 * (i + 1), -0.01 * (i + 1)};
+    sprite_init(&entities[i], 10, 20, 1, 1, image);
+    entities[i].dx = i + 1;
+    entities[i].dy = -(i + 1);
+  }
+
+  unsigned long changed = 0;
+  unsigned long long t0 = bench_now_ns();
+  for (unsigned long n = 0; n < steps; n++){
+    changed += body_step(&bodies[n & 7]);
+    if ((n & 0xFFFF) == 0) bodies[n & 7] = (Body){10, 20, bodies[n & 7].dx, bodies[n & 7].dy};
+  }
+  unsigned long long t1 = bench_now_ns();
+  for (unsigned long n = 0; n < steps; n++){
+    changed += sprite_step(&entities[n & 7]);
+    if ((n & 0xFFFF) == 0) sprite_init(&entities[n & 7], 10, 20, 1, 1, image);
+  }
+  unsigned long long t2 = bench_now_ns();
+
+  printf("double step      %10.2f ns\n", (double)(t1 - t0) / steps);
+  printf("fixed step       %10.2f ns\n", (double)(t2 - t1) / steps);
+  printf("(%lu pixel changes)\n", changed);
+  return 0;
+}
+
+//Scripted inputs: the ship sweeps a square holding each direction for 40
+//frames, fires every 7th frame, taps a serial key every 13th frame, and the
+//potentiometer ramps across its full range.
+static void script_inputs(unsigned long frame){
+  PINB = 0;
+  PIND = 0;
+  PINF = 0;
+
+  switch ((frame / 40) % 4){
+    case 0: PIND |= 1 << 1; break; //UP
+    case 1: PIND |= 1 << 0; break; //RIGHT
+    case 2: PINB |= 1 << 7; break; //DOWN
+    case 3: PINB |= 1 << 1; break; //LEFT
+  }
+
+  if (frame % 7 == 0){
+    PINF |= 1 << 5;
+  }
+
+  if (frame % 13 == 0){
+    host_serial_key("wasdk"[(frame / 13) % 5]);
+  }
+
+  host_adc_input = frame % 1024;
+}
+
+//Checks the sine table and CORDIC atan2 against libm, and times both. An
+//atan2 error is in binary angles (1/256 of a turn, 1.4 degrees).
+static volatile double sink_d;
+static volatile int sink_i;
+
+static int trig(unsigned long calls){
+  double worst_sin = 0;
+  for (int a = 0; a < 256; a++){
+    double err = fabs(trig_sin(a) / 16384.0 - sin(a * 2 * M_PI / 256));
+    if (err > worst_sin) worst_sin = err;
+    err = fabs(trig_cos(a) / 16384.0 - cos(a * 2 * M_PI / 256));
+    if (err > worst_sin) worst_sin = err;
+  }
+
+  //Every direction the game's vectors can take, short and long
+  double worst_atan = 0;
+  long tested = 0;
+  for (int dy = -128; dy <= 128; dy++){
+    for (int dx = -128; dx <= 128; dx++){
+      if (dx == 0 && dy == 0) continue;
+      for (int scale = 1; scale < 256; scale = scale * 16 - 1){
+        double exact = atan2(dy, dx) * 256 / (2 * M_PI);
+        double err = fabs(fmod(trig_atan2(dy * scale, dx * scale) - exact + 384, 256) - 128);
+        if (err > worst_atan) worst_atan = err;
+        tested++;
+      }
+    }
+  }
+
+  printf("sin/cos          max error %.6f (table step %.6f)\n", worst_sin, 1 / 16384.0);
+  printf("atan2            max error %.3f of a binary angle over %ld vectors\n", worst_atan, tested);
+
+  unsigned long long t0 = bench_now_ns();
+  for (unsigned long n = 0; n < calls; n++){
+    sink_d = sin((n & 255) * (2 * M_PI / 256));
+  }
+  unsigned long long t1 = bench_now_ns();
+  for (unsigned long n = 0; n < calls; n++){
+    sink_i = trig_sin(n);
+  }
+  unsigned long long t2 = bench_now_ns();
+  for (unsigned long n = 0; n < calls; n++){
+    sink_d = atan2((int)(n & 127) - 64, (int)((n >> 7) & 127) - 64);
+  }
+  unsigned long long t3 = bench_now_ns();
+  for (unsigned long n = 0; n < calls; n++){
+    sink_i = trig_atan2((int)(n & 127) - 64, (int)((n >> 7) & 127) - 64);
+  }
+  unsigned long long t4 = bench_now_ns();
+
+  printf("libm sin         %10.2f ns\n", (double)(t1 - t0) / calls);
+  printf("table sin        %10.2f ns\n", (double)(t2 - t1) / calls);
+  printf("libm atan2       %10.2f ns\n", (double)(t3 - t2) / calls);
+  printf("CORDIC atan2     %10.2f ns\n", (double)(t4 - t3) / calls);
+  return 0;
+}
+
+//Draws the HUD at scores of every width it shows, and checks each against the
+//score-0 HUD with the score redrawn by draw_string() at the old position:
+//every digit shown, and nothing to the right of the score disturbed.
+#define HUD_SCORE_X 29
+#define HUD_SCORE_W 20 //Four glyphs
+
+static int hud(void){
+  static const int scores[] = {0, 7, 42, 999, 1000, 1850, 2505, 9999};
+  static unsigned char blank[LCD_BUFFER_SIZE];
+  int failed = 0;
+
+  for (unsigned i = 0; i < sizeof scores / sizeof scores[0]; i++){
+    hud_init();
+    lives = 3;
+    score = scores[i];
+    status_display();
+    if (i == 0){
+      memcpy(blank, screen_buffer, LCD_BUFFER_SIZE);
+    }
+    static unsigned char shown[LCD_BUFFER_SIZE];
+    memcpy(shown, screen_buffer, LCD_BUFFER_SIZE);
+
+    memcpy(screen_buffer, blank, LCD_BUFFER_SIZE);
+    for (int x = HUD_SCORE_X; x < HUD_SCORE_X + HUD_SCORE_W; x++){
+      for (int y = 1; y < 9; y++){
+        draw_pixel(x, y, 0);
+      }
+    }
+    char text[8];
+    sprintf(text, "%d", scores[i]);
+    draw_string(HUD_SCORE_X, 1, text);
+
+    bool same = memcmp(shown, screen_buffer, LCD_BUFFER_SIZE) == 0;
+    printf("score %-6d      %s\n", scores[i], same ? "ok" : "WRONG");
+    failed |= !same;
+  }
+  return failed;
+}
+
+//The attack functions' old path: a double sqrt and two divisions
+static void aim_double(Entity* sprite, int16_t x, int16_t y, double speed){
+  double dx = x - sprite->x;
+  double dy = y - sprite->y;
+  double dist = sqrt((dx * dx) + (dy * dy));
+  sprite->dx = dist ? round(dx * speed * 256 / dist) : 0;
+  sprite->dy = dist ? round(dy * speed * 256 / dist) : 0;
+}
+
+//Aims from every pixel and half pixel of the screen at a fixed ship, at the
+//three attack speeds, and compares sprite_aim_at() with the double path.
+static int normalise(unsigned long calls){
+  static const double speeds[] = {1.5, 0.75, 1.0};
+  static unsigned char image[1] = {0x80};
+  Entity e;
+  sprite_init(&e, 0, 0, 1, 1, image);
+
+  double worst_speed = 0, worst_heading = 0;
+  int worst_lsb = 0;
+  for (int s = 0; s < 3; s++){
+    int16_t speed = (int16_t)(speeds[s] * 256);
+    for (int y = 0; y < LCD_Y * 2; y++){
+      for (int x = 0; x < LCD_X * 2; x++){
+        int16_t tx = 40 * 256 + 77, ty = 25 * 256 + 200;
+        e.x = x * 128;
+        e.y = y * 128;
+        if (e.x == tx && e.y == ty) continue;
+
+        aim_double(&e, tx, ty, speeds[s]);
+        int16_t rx = e.dx, ry = e.dy;
+        sprite_aim_at(&e, tx, ty, speed);
+
+        double got = hypot(e.dx, e.dy) / speed - 1;
+        double heading = fabs(atan2(e.dy, e.dx) - atan2(ry, rx)) * 180 / M_PI;
+        if (heading > 180) heading = 360 - heading;
+        int lsb = abs(e.dx - rx) > abs(e.dy - ry) ? abs(e.dx - rx) : abs(e.dy - ry);
+        if (fabs(got) > worst_speed) worst_speed = fabs(got);
+        if (heading > worst_heading) worst_heading = heading;
+        if (lsb > worst_lsb) worst_lsb = lsb;
+      }
+    }
+  }
+
+  printf("speed            max error %.2f%%\n", worst_speed * 100);
+  printf("heading          max error %.2f degrees\n", worst_heading);
+  printf("components       max %d/256 px/frame from the double path\n", worst_lsb);
+
+  int16_t tx = 40 * 256, ty = 25 * 256;
+  unsigned long long t0 = bench_now_ns();
+  for (unsigned long n = 0; n < calls; n++){
+    e.x = (n & 63) << 8;
+    e.y = ((n >> 6) & 31) << 8;
+    aim_double(&e, tx, ty, 1.5);
+  }
+  unsigned long long t1 = bench_now_ns();
+  for (unsigned long n = 0; n < calls; n++){
+    e.x = (n & 63) << 8;
+    e.y = ((n >> 6) & 31) << 8;
+    sprite_aim_at(&e, tx, ty, 384);
+  }
+  unsigned long long t2 = bench_now_ns();
+
+  printf("sqrt path        %10.2f ns\n", (double)(t1 - t0) / calls);
+  printf("octagon path     %10.2f ns\n", (double)(t2 - t1) / calls);
+  return 0;
+}
+
+//Moves the ship around the screen and keeps up to 64 enemies homing on it,
+//either through the flow field or each aiming with sprite_aim_at(). Reports
+//the cost per frame and how far the flow headings are from the direct ones.
+#define FLOW_MAX 64
+
+static int flow(unsigned long frames){
+  static const int counts[] = {0, 8, 32, FLOW_MAX};
+  static unsigned char image[1] = {0x80};
+  static Entity e[FLOW_MAX];
+  for (int i = 0; i < FLOW_MAX; i++){
+    sprite_init(&e[i], (i * 37) % LCD_X, 10 + (i * 23) % (LCD_Y - 10), 1, 1, image);
+  }
+  sprite_init(&ship, LCD_X / 2, LCD_Y / 2, 1, 1, image);
+  flow_update();
+
+  //Heading error from every pixel, with the ship at every seventh pixel
+  double worst = 0, total = 0;
+  unsigned long samples = 0;
+  Entity probe = e[0], direct = e[0];
+  for (int sy = 0; sy < LCD_Y; sy += 7){
+    for (int sx = 0; sx < LCD_X; sx += 7){
+      ship.x = sx << 8;
+      ship.y = sy << 8;
+      flow_update();
+      for (int y = 0; y < LCD_Y; y++){
+        for (int x = 0; x < LCD_X; x++){
+          if (x == sx && y == sy) continue;
+          probe.x = direct.x = x << 8;
+          probe.y = direct.y = y << 8;
+          flow_aim(&probe, 384);
+          sprite_aim_at(&direct, ship.x, ship.y, 384);
+          double error = fabs(atan2(probe.dy, probe.dx) - atan2(direct.dy, direct.dx)) * 180 / M_PI;
+          if (error > 180) error = 360 - error;
+          if (error > worst) worst = error;
+          total += error;
+          samples++;
+        }
+      }
+    }
+  }
+  printf("heading          max error %.1f degrees, mean %.2f\n", worst, total / samples);
+
+  //The ship circles the screen at about a pixel per frame, as it does in play
+  for (int c = 0; c < 4; c++){
+    unsigned long long cost[2];
+    for (int way = 0; way < 2; way++){
+      unsigned long long t0 = bench_now_ns();
+      for (unsigned long f = 0; f < frames; f++){
+        double a = f * 2 * M_PI / 400;
+        ship.x = (int16_t)((LCD_X / 2 + 30 * cos(a)) * 256);
+        ship.y = (int16_t)((LCD_Y / 2 + 15 * sin(a)) * 256);
+        if (way == 0) flow_update();
+        for (int i = 0; i < counts[c]; i++){
+          if (way == 0) flow_aim(&e[i], 384);
+          else sprite_aim_at(&e[i], ship.x, ship.y, 384);
+        }
+      }
+      cost[way] = bench_now_ns() - t0;
+    }
+    printf("%2d enemies       flow %8.1f ns/frame, aim_at %8.1f ns/frame\n",
+      counts[c], (double)cost[0] / frames, (double)cost[1] / frames);
+  }
+  return 0;
+}
+
+//Drives the timer wheel on its own: every event is scheduled, rescheduled
+//and cancelled at random, from inside its own firing and from outside, with
+//delays of every length the wheel takes. The delays include whole laps of a
+//level 1 block, which land in the block slot that has just moved down. A
+//reference list of due frames checks that each event fires exactly on its
+//frame, and never after being cancelled. The run is long enough for
+//wheel_now to wrap.
+static long long wheel_expect[WHEEL_EVENTS]; //Absolute due frame, -1 when idle
+static long long wheel_frame;
+static unsigned long wheel_fired, wheel_wrong;
+
+static void wheel_random(uint8_t event){
+  uint16_t frames;
+  switch (rand() % 4){
+    case 0: frames = 1 + rand() % WHEEL_SLOTS; break;
+    case 1: frames = WHEEL_SLOTS * (1 + rand() % (WHEEL_SLOTS - 1)); break;
+    case 2: frames = WHEEL_MAX - rand() % 3; break;
+    default: frames = 1 + rand() % WHEEL_MAX; break;
+  }
+  wheel_schedule(event, frames);
+  wheel_expect[event] = wheel_frame + frames;
+}
+
+static void wheel_check(uint8_t event){
+  wheel_fired++;
+  if (event >= WHEEL_EVENTS || wheel_expect[event] != wheel_frame){
+    wheel_wrong++;
+  }
+  wheel_expect[event] = -1;
+
+  //Reschedule itself most of the time, and disturb another event
+  if (rand() % 4){
+    wheel_random(event);
+  }
+  uint8_t other = rand() % WHEEL_EVENTS;
+  if (rand() % 8 == 0){
+    wheel_cancel(other);
+    wheel_expect[other] = -1;
+  }
+  else if (rand() % 8 == 0){
+    wheel_random(other);
+  }
+}
+
+static int wheel(unsigned long frames, unsigned seed){
+  srand(seed);
+  wheel_reset();
+  bench_wheel = wheel_check;
+  wheel_frame = 0;
+  for (int e = 0; e < WHEEL_EVENTS; e++){
+    wheel_random(e);
+  }
+
+  unsigned long late = 0, wraps = 0;
+  for (unsigned long f = 0; f < frames; f++){
+    wheel_frame++;
+    wheel_tick();
+    if (wheel_now == 0){
+      wraps++;
+    }
+
+    if (rand() % 16 == 0){
+      wheel_random(rand() % WHEEL_EVENTS);
+    }
+
+    //Anything still due on or before this frame was missed
+    for (int e = 0; e < WHEEL_EVENTS; e++){
+      if (wheel_expect[e] >= 0 && wheel_expect[e] <= wheel_frame){
+        late++;
+        wheel_expect[e] = -1;
+      }
+    }
+  }
+  bench_wheel = NULL;
+
+  printf("frames           %lu (wheel_now wrapped %lu times)\n", frames, wraps);
+  printf("events fired     %lu\n", wheel_fired);
+  printf("early or extra   %lu\n", wheel_wrong);
+  printf("late or missed   %lu\n", late);
+  return wheel_wrong || late ? 1 : 0;
+}
+
+//Taps shorter than a frame, one button at a time, plus a burst of serial
+//keys every frame. A button sampled only at the top of the frame would miss
+//every tap; the edge queue should catch each one.
+#define TAP_US 10000
+#define BURST 3
+
+static int input_taps(unsigned long frames){
+  init_hardware();
+  hud_init();
+  game_start(1);
+
+  static const char* const button_name[] = {"up", "right", "down", "left", "fire"};
+  unsigned long tapped[5] = {0}, seen[5] = {0};
+  unsigned long keys = 0, keys_seen = 0, keys_left = 0;
+
+  for (unsigned long frame = 0; frame < frames; frame++){
+    tick_wait();
+
+    int b = frame % 5;
+    uint8_t pinb = 0, pind = 0, pinf = 0;
+    switch (b){
+      case 0: pind = 1 << 1; break; //UP
+      case 1: pind = 1 << 0; break; //RIGHT
+      case 2: pinb = 1 << 7; break; //DOWN
+      case 3: pinb = 1 << 1; break; //LEFT
+      case 4: pinf = 1 << 5; break; //FIRE
+    }
+
+    //Press partway through the frame and let go before it ends
+    host_advance_us(TAP_US);
+    host_set_pins(pinb, pind, pinf);
+    host_advance_us(TAP_US);
+    host_set_pins(0, 0, 0);
+    tapped[b]++;
+
+    //Distinct game keys, so each one shows up as its own button bit
+    uint8_t expect = 0;
+    for (int k = 0; k < BURST; k++){
+      char key = "wdsak"[(frame + k) % 5];
+      host_serial_key(key);
+      expect |= input_key_buttons(key);
+      keys++;
+    }
+
+    input_sample();
+    if (input.buttons & (1 << b)){
+      seen[b]++;
+    }
+    for (int k = 0; k < 5; k++){
+      if (expect & input.buttons & (1 << k)){
+        keys_seen++;
+      }
+    }
+    keys_left += usb_serial_available();
+    host_serial_clear();
+
+    lives = 6;
+    process();
+    log_drain();
+  }
+
+  for (int k = 0; k < 5; k++){
+    printf("%-6s taps      %lu of %lu seen\n", button_name[k], seen[k], tapped[k]);
+  }
+  printf("serial keys      %lu sent, %lu seen, %lu left queued\n", keys, keys_seen, keys_left);
+  return 0;
+}
+
+//Presses UP at a random point in every fourth frame and holds it for two
+//frames, so each press is the only input its frame takes. The game times
+//each one from the ISR to the end of dirty_flush(), while every LCD byte
+//advances the simulated clock by lcd_ns.
+static int latency(unsigned long presses, unsigned long lcd_ns){
+#if LATENCY_CHECK
+  init_hardware();
+  hud_init();
+  game_start(1);
+  host_lcd_byte_ns = lcd_ns;
+
+  uint32_t random = 12345;
+  unsigned long frames = presses * 4;
+  for (unsigned long frame = 0; frame < frames; frame++){
+    tick_wait();
+    input_sample();
+    lives = 6;
+    process();
+    latency_report();
+    log_drain();
+
+    if (frame % 4 == 0){
+      //Somewhere in what is left of the 50 ms frame
+      random = random * 1103515245 + 12345;
+      host_advance_us((random >> 8) % 45000);
+      host_set_pins(0, 1 << 1, 0);
+    }
+    else if (frame % 4 == 2){
+      host_set_pins(0, 0, 0);
+    }
+  }
+
+  unsigned long total = 0, most = 1;
+  double sum = 0;
+  for (int bin = 0; bin < LATENCY_BINS; bin++){
+    total += latency_hist[bin];
+    sum += latency_hist[bin] * (bin * LATENCY_BIN_MS + LATENCY_BIN_MS / 2.0);
+    if (latency_hist[bin] > most){
+      most = latency_hist[bin];
+    }
+  }
+
+  printf("presses          %lu timed, lcd %lu ns/byte\n", total, lcd_ns);
+  for (int bin = 0; bin < LATENCY_BINS; bin++){
+    if (latency_hist[bin] == 0){
+      continue;
+    }
+    printf("%3d-%3d ms %7u ", bin * LATENCY_BIN_MS, bin * LATENCY_BIN_MS + LATENCY_BIN_MS - 1, latency_hist[bin]);
+    for (unsigned long n = 0; n < latency_hist[bin] * 40 / most; n++){
+      putchar('#');
+    }
+    putchar('\n');
+  }
+  printf("mean             %10.1f ms (bin centres)\n", total ? sum / total : 0.0);
+  return 0;
+#else
+  (void)presses;
+  (void)lcd_ns;
+  fprintf(stderr, "latency needs a build with -DLATENCY_CHECK=1\n");
+  return 1;
+#endif
+}
+
+//Simulated CPU time for each phase of process(); illustrative figures for
+//a heavy frame, so that the LCD transfer has work to overlap with
+#define FLUSH_MOVEMENT_US 1500
+#define FLUSH_COLLISION_US 1500
+#define FLUSH_RENDER_US 2000
+
+static int flush(unsigned long frames, unsigned long lcd_ns){
+  init_hardware();
+  hud_init();
+  game_start(1);
+  host_lcd_byte_ns = lcd_ns;
+
+  static unsigned char composed[LCD_BUFFER_SIZE];
+  unsigned long torn = 0;
+  unsigned long long bytes0 = host_lcd_bytes;
+  unsigned long long start_us = host_time_us;
+
+  host_phase_us[BENCH_MOVEMENT] = FLUSH_MOVEMENT_US;
+  host_phase_us[BENCH_COLLISION] = FLUSH_COLLISION_US;
+  host_phase_us[BENCH_RENDER] = FLUSH_RENDER_US;
+  memset(host_lcd_phase_bytes, 0, sizeof(host_lcd_phase_bytes));
+
+  //No tick_wait: each frame starts as soon as the last one has been drawn
+  for (unsigned long frame = 0; frame < frames; frame++){
+    script_inputs(frame);
+    input_sample();
+    lives = 6;
+    process();
+    bench_mark(BENCH_IDLE);
+
+    //process() has just waited for the previous frame's transfer and started
+    //this one's, without time passing since: the LCD holds that frame, in
+    //full, however much the next frame has drawn over screen_buffer
+    if (frame > 0 && memcmp(host_lcd, LCD_ASYNC ? composed : screen_buffer, LCD_BUFFER_SIZE) != 0){
+      torn++;
+    }
+    memcpy(composed, screen_buffer, LCD_BUFFER_SIZE);
+  }
+  dirty_wait();
+  memset(host_phase_us, 0, sizeof(host_phase_us));
+
+  unsigned long long bytes = host_lcd_bytes - bytes0;
+  unsigned long long overlapped = host_lcd_phase_bytes[BENCH_MOVEMENT] + host_lcd_phase_bytes[BENCH_COLLISION];
+  printf("frames           %lu (lcd %lu ns/byte, %s)\n", frames, lcd_ns, LCD_ASYNC ? "pumped" : "synchronous");
+  printf("frame time       %10.2f ms simulated\n", (host_time_us - start_us) / 1000.0 / frames);
+  printf("lcd bytes        %10.1f /frame\n", (double)bytes / frames);
+  printf("sent while simulating %5.1f%%\n", bytes ? 100.0 * overlapped / bytes : 0.0);
+  printf("torn frames      %lu\n", torn);
+  return 0;
+}
+
+//Decodes the profiler's '%' lines from a USB capture into a table: per
+//zone, the lowest minimum, the highest maximum and the mean over every
+//report. A Teensy count is 1000 ns; the host build counts nanoseconds.
+static int profile_decode(const char* path, double ns_per_count){
+  FILE* file = fopen(path, "r");
+  if (file == NULL){
+    perror(path);
+    return 1;
+  }
+
+  static const char* const zone_name[PROFILE_ZONES] = {
+    "input", "aliens", "mothership", "missiles", "collision", "render", "status"
+  };
+  unsigned long lo[PROFILE_ZONES], hi[PROFILE_ZONES] = {0}, samples[PROFILE_ZONES] = {0};
+  double total[PROFILE_ZONES] = {0};
+  unsigned long reports = 0;
+
+  char line[128];
+  while (fgets(line, sizeof line, file)){
+    unsigned zone, min, max, mean, count;
+    if (line[0] != '%' || sscanf(line + 1, "%1x%4x%4x%4x%4x", &zone, &min, &max, &mean, &count) != 5 || zone >= PROFILE_ZONES){
+      continue;
+    }
+    if (samples[zone] == 0 || min < lo[zone]){
+      lo[zone] = min;
+    }
+    if (max > hi[zone]){
+      hi[zone] = max;
+    }
+    total[zone] += (double)mean * count;
+    samples[zone] += count;
+    reports++;
+  }
+  fclose(file);
+
+  if (reports == 0){
+    fprintf(stderr, "%s: no profiler lines (build with -DPROFILE=1)\n", path);
+    return 1;
+  }
+
+  //Cycles at the Teensy's 8 MHz
+  double us = ns_per_count / 1000.0;
+  printf("zone        samples     min us    mean us     max us  mean cycles\n");
+  for (int zone = 0; zone < PROFILE_ZONES; zone++){
+    if (samples[zone] == 0){
+      continue;
+    }
+    double mean = total[zone] / samples[zone];
+    printf("%-10s %8lu %10.1f %10.1f %10.1f %12.0f\n", zone_name[zone], samples[zone],
+           lo[zone] * us, mean * us, hi[zone] * us, mean * us * 8);
+  }
+  return 0;
+}
+
+//Boots through the scene loop, then plays games of PLAY_FRAMES frames,
+//ending each with game_end() and tapping a button on the menu screens.
+#define PLAY_FRAMES 60
+
+static int restarts(unsigned long games){
+  init_hardware();
+  hud_init();
+
+  unsigned long done = 0, frame = 0, played = 0;
+  unsigned long total_ms = 0, worst_ms = 0;
+  uint16_t first_stack = 0;
+
+  while (done < games){
+    bool menu = scene == SCENE_INTRO || scene == SCENE_GAME_OVER;
+    PINB = 0;
+    PIND = 0;
+    PINF = (menu && (frame++ & 2)) ? 1 << 5 : 0;
+
+    if (scene == SCENE_PLAY && ++played >= PLAY_FRAMES){
+      played = 0;
+      lives = 1;
+      game_end();
+    }
+
+    bool pending = restart_pending;
+    scene_step();
+
+    //The first frame after a restart has just been drawn
+    if (pending && !restart_pending){
+      done++;
+      total_ms += restart_ms;
+      if (restart_ms > worst_ms) worst_ms = restart_ms;
+      if (done == 1) first_stack = stack_deepest[0];
+    }
+  }
+
+  printf("restarts         %lu\n", done);
+  printf("restart to frame %10.1f ms average, %lu ms worst\n", (double)total_ms / done, worst_ms);
+  printf("main loop stack  %u bytes after the first, %u after the last\n", first_stack, stack_deepest[0]);
+  printf("simulated time   %.1f s\n", host_time_us / 1e6);
+  return 0;
+}
+
+//Traces: the magic, the seed as a little-endian word, then one input record
+//per frame. A text capture of the game's RECORD_INPUT log replays the same
+//way: each '@' seed line starts a game, whose '>' record lines (in hex)
+//follow it, and anything else is ignored. A capture whose log ring
+//overflowed ("records dropped") has lost records and is refused.
+#define TRACE_MAGIC "HRD1"
+#define TRACE_GAMES 256
+
+static uint8_t* trace;
+static size_t trace_length, trace_at;
+static size_t trace_start[TRACE_GAMES + 1]; //Each game's first record; the last entry is trace_length
+static uint16_t trace_seed[TRACE_GAMES];
+static int trace_games;
+static bool trace_text;                     //A capture from the game, not a bench recording
+
+static int trace_load(const char* path){
+  FILE* file = fopen(path, "rb");
+  if (file == NULL){
+    perror(path);
+    return -1;
+  }
+
+  size_t size = 0, capacity = 4096;
+  uint8_t* data = malloc(capacity);
+  size_t n;
+  while ((n = fread(data + size, 1, capacity - size, file)) > 0){
+    size += n;
+    if (size == capacity){
+      capacity *= 2;
+      data = realloc(data, capacity);
+    }
+  }
+  fclose(file);
+
+  if (size >= 6 && memcmp(data, TRACE_MAGIC, 4) == 0){
+    trace = data;
+    trace_length = size;
+    trace_games = 1;
+    trace_seed[0] = data[4] | (data[5] << 8);
+    trace_start[0] = 6;
+    trace_start[1] = size;
+    trace_text = false;
+    return 0;
+  }
+
+  //Text capture: decode the hex of each record line in place
+  trace = malloc(size);
+  trace_length = 0;
+  trace_games = 0;
+  trace_text = true;
+  for (size_t i = 0; i < size; i++){
+    if (i == 0 || data[i - 1] == '\n'){
+      unsigned value;
+      if (data[i] == '@' && sscanf((char*)data + i + 1, "%4x", &value) == 1){
+        if (trace_games == TRACE_GAMES){
+          fprintf(stderr, "%s: more than %d games\n", path, TRACE_GAMES);
+          free(data);
+          return -1;
+        }
+        trace_seed[trace_games] = value;
+        trace_start[trace_games++] = trace_length;
+      }
+      else if (data[i] == '>'){
+        if (trace_games == 0){
+          fprintf(stderr, "%s: input records before the first seed line\n", path);
+          free(data);
+          return -1;
+        }
+        for (size_t j = i + 1; j + 1 < size && isxdigit(data[j]) && isxdigit(data[j + 1]); j += 2){
+          sscanf((char*)data + j, "%2x", &value);
+          trace[trace_length++] = value;
+        }
+      }
+      else if (sscanf((char*)data + i, "[DBG] %u records dropped", &value) == 1){
+        fprintf(stderr, "%s: the game dropped %u log records; the capture can't be replayed\n", path, value);
+        free(data);
+        return -1;
+      }
+    }
+  }
+  free(data);
+
+  if (trace_games == 0){
+    fprintf(stderr, "%s: no seed line\n", path);
+    return -1;
+  }
+  trace_start[trace_games] = trace_length;
+  return 0;
+}
+
+//FNV-1a over the frame and score, folded into a running session hash
+static uint32_t frame_hash(uint32_t hash){
+  for (int i = 0; i < LCD_BUFFER_SIZE; i++){
+    hash = (hash ^ screen_buffer[i]) * 16777619u;
+  }
+  return (hash ^ (uint32_t)score) * 16777619u;
+}
+
+int main(int argc, char** argv){
+  //Stack depths are measured down from here
+  host_ramend = SP;
+
+  if (argc > 2 && strcmp(argv[1], "usb") == 0){
+    host_usb_capture = fopen(argv[2], "w");
+    if (host_usb_capture == NULL){
+      perror(argv[2]);
+      return 1;
+    }
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc > 2 && strcmp(argv[1], "profile") == 0){
+    return profile_decode(argv[2], argc > 3 ? strtod(argv[3], NULL) : 1000.0);
+  }
+
+  if (argc > 1 && strcmp(argv[1], "kinematics") == 0){
+    return kinematics(argc > 2 ? strtoul(argv[2], NULL, 10) : 100000000);
+  }
+  if (argc > 1 && strcmp(argv[1], "normalise") == 0){
+    return normalise(argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000);
+  }
+  if (argc > 1 && strcmp(argv[1], "flow") == 0){
+    return flow(argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000);
+  }
+  if (argc > 1 && strcmp(argv[1], "wheel") == 0){
+    return wheel(argc > 2 ? strtoul(argv[2], NULL, 10) : 3000000,
+                 argc > 3 ? strtoul(argv[3], NULL, 10) : 1);
+  }
+  if (argc > 1 && strcmp(argv[1], "hud") == 0){
+    return hud();
+  }
+  if (argc > 1 && strcmp(argv[1], "trig") == 0){
+    return trig(argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000);
+  }
+  if (argc > 1 && strcmp(argv[1], "input") == 0){
+    return input_taps(argc > 2 ? strtoul(argv[2], NULL, 10) : 10000);
+  }
+  if (argc > 1 && strcmp(argv[1], "latency") == 0){
+    return latency(argc > 2 ? strtoul(argv[2], NULL, 10) : 2000,
+                   argc > 3 ? strtoul(argv[3], NULL, 10) : 10000);
+  }
+  if (argc > 1 && strcmp(argv[1], "flush") == 0){
+    return flush(argc > 2 ? strtoul(argv[2], NULL, 10) : 10000,
+                 argc > 3 ? strtoul(argv[3], NULL, 10) : 10000);
+  }
+  if (argc > 1 && strcmp(argv[1], "restart") == 0){
+    return restarts(argc > 2 ? strtoul(argv[2], NULL, 10) : 1000);
+  }
+
+  FILE* record = NULL;
+  bool replay = false;
+  if (argc > 2 && strcmp(argv[1], "record") == 0){
+    record = fopen(argv[2], "wb");
+    if (record == NULL){
+      perror(argv[2]);
+      return 1;
+    }
+    argc -= 2;
+    argv += 2;
+  }
+  else if (argc > 2 && strcmp(argv[1], "replay") == 0){
+    replay = true;
+  }
+
+  unsigned long frames = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  uint16_t seed = argc > 2 ? (uint16_t)strtoul(argv[2], NULL, 10) : 1;
+
+  int game = 0;
+  if (replay){
+    if (trace_load(argv[2]) != 0){
+      return 1;
+    }
+    seed = trace_seed[0];
+    trace_at = trace_start[0];
+    frames = ~0UL;
+  }
+
+  if (record){
+    uint8_t header[6] = {'H', 'R', 'D', '1', seed & 0xFF, seed >> 8};
+    fwrite(header, 1, sizeof header, record);
+  }
+
+  init_hardware();
+  hud_init();
+
+  game_start(seed);
+  scene_set(SCENE_PLAY);
+
+  bench_reset();
+  unsigned long mismatches = 0;
+  uint32_t hash = 2166136261u;
+  bench_pair_tests = 0;
+  bench_pixel_tests = 0;
+  unsigned long long lcd0 = host_lcd_bytes, usb0 = host_usb_bytes;
+  unsigned long long start = bench_now_ns();
+
+  unsigned long frame;
+  for (frame = 0; frame < frames; frame++){
+    //The main loop sleeps here until the next simulation tick
+    tick_wait();
+
+    if (replay){
+      //The capture's next game started before this one ended
+      if (trace_at >= trace_start[game + 1] && game + 1 < trace_games){
+        fprintf(stderr, "replay: game %d was still running when the capture started game %d (frame %lu)\n",
+          game + 1, game + 2, frame);
+        return 1;
+      }
+      if (trace_at + 2 > trace_start[game + 1]){
+        break;
+      }
+      trace_at += input_decode(trace + trace_at, &input);
+    }
+    else {
+      script_inputs(frame);
+      input_sample();
+    }
+
+    if (record){
+      uint8_t bytes[INPUT_RECORD_MAX];
+      fwrite(bytes, 1, input_encode(&input, bytes), record);
+    }
+
+    //Keep a scripted game running; game over would leave the play scene.
+    //A capture from the game plays its deaths and game overs out.
+    if (!replay || !trace_text){
+      lives = 6;
+    }
+
+    process();
+    bench_mark(BENCH_TELEMETRY);
+    stack_report();
+    latency_report();
+    profile_report();
+    log_drain();
+    bench_mark(BENCH_IDLE);
+
+    //Whatever the renderer chose to flush, the LCD must match the frame
+    //once the pump has sent it
+    dirty_wait();
+    if (memcmp(host_lcd, screen_buffer, LCD_BUFFER_SIZE) != 0){
+      mismatches++;
+    }
+    hash = frame_hash(hash);
+
+    //A captured game over: the records end here, and the next game (if any)
+    //starts from its own seed
+    if (replay && scene == SCENE_GAME_OVER){
+      if (trace_at < trace_start[game + 1]){
+        fprintf(stderr, "replay: game %d ended at frame %lu with %zu bytes of records left\n",
+          game + 1, frame + 1, trace_start[game + 1] - trace_at);
+        return 1;
+      }
+      if (++game == trace_games){
+        frame++;
+        break;
+      }
+      trace_at = trace_start[game];
+      game_start(trace_seed[game]);
+      scene_set(SCENE_PLAY);
+    }
+  }
+  frames = frame;
+
+  unsigned long long total = bench_now_ns() - start;
+  double n = frames ? (double)frames : 1.0;
+
+  if (record){
+    fclose(record);
+  }
+
+  printf("frames           %lu\n", frames);
+  if (replay){
+    printf("games            %d of %d\n", game < trace_games ? game + 1 : game, trace_games);
+  }
+  printf("total            %10.1f ns/frame\n", total / n);
+  printf("  movement       %10.1f ns/frame\n", bench_phase_ns[BENCH_MOVEMENT] / n);
+  printf("  collision      %10.1f ns/frame\n", bench_phase_ns[BENCH_COLLISION] / n);
+  printf("  render         %10.1f ns/frame\n", bench_phase_ns[BENCH_RENDER] / n);
+  printf("  telemetry      %10.1f ns/frame\n", bench_phase_ns[BENCH_TELEMETRY] / n);
+  printf("  timers+harness %10.1f ns/frame\n", bench_phase_ns[BENCH_IDLE] / n);
+  printf("pair tests       %10.2f /frame\n", bench_pair_tests / n);
+  printf("pixel tests      %10.2f /frame\n", bench_pixel_tests / n);
+  printf("lcd bytes        %10.1f /frame\n", (host_lcd_bytes - lcd0) / n);
+  printf("lcd mismatches   %lu frames\n", mismatches);
+  printf("usb bytes        %10.1f /frame\n", (host_usb_bytes - usb0) / n);
+  printf("overruns         %u ticks\n", frame_overruns);
+  printf("simulated time   %.1f s\n", host_time_us / 1e6);
+  printf("final score      %d\n", score);
+  printf("session hash     %08x\n", hash);
+  for (int site = 0; site < STACK_SITES; site++){
+    if (stack_deepest[site]){
+      printf("stack %-18s %5u bytes\n", stack_name[site], stack_deepest[site]);
+    }
+    else {
+      printf("stack %-18s   not reached\n", stack_name[site]);
+    }
+  }
+
+  return 0;
+}
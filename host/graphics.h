@@ -0,0 +1,17 @@
+#ifndef HOST_GRAPHICS_H
+#define HOST_GRAPHICS_H
+
+#include "lcd.h"
+
+#define LCD_BUFFER_SIZE (LCD_X * (LCD_Y / 8))
+
+extern unsigned char screen_buffer[LCD_BUFFER_SIZE];
+
+void show_screen(void);
+void clear_screen(void);
+void draw_pixel(unsigned char x, unsigned char y, unsigned char value);
+void draw_line(int x1, int y1, int x2, int y2);
+void draw_char(unsigned char x, unsigned char y, char character);
+void draw_string(unsigned char x, unsigned char y, char* string);
+
+#endif
@@ -0,0 +1,436 @@
+//Host implementations of the Teensy libraries used by The-Horde.c: the AVR
+//registers, LCD and graphics, sprites, USB serial and the delay/timer clock.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <avr/io.h>
+#include <util/delay.h>
+
+#include "lcd.h"
+#include "graphics.h"
+#include "sprite.h"
+#include "usb_serial.h"
+#include "host.h"
+
+//REGISTERS
+volatile uint8_t PINB, PIND, PINF;
+volatile uint8_t DDRB, DDRD, DDRF;
+volatile uint8_t PORTB, PORTD, PORTF;
+
+volatile uint8_t EICRA, EIMSK;
+volatile uint8_t PCICR, PCMSK0;
+
+volatile uint8_t TCCR0A, TCCR0B, TIMSK0, TIFR0, TCNT0, OCR0A;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+uint16_t host_ramend;
+volatile uint16_t TCNT1, OCR1A;
+volatile uint8_t TCCR3A, TCCR3B;
+
+volatile uint8_t ADMUX, ADCSRB;
+volatile uint16_t ADC;
+volatile uint8_t CLKPR;
+volatile uint8_t SREG;
+
+uint16_t host_adc_input = 0;
+
+static volatile uint8_t adcsra;
+
+volatile uint8_t* host_adcsra(void){
+  if ((adcsra & (1 << ADSC)) && !(adcsra & (1 << ADATE))){
+    ADC = host_adc_input & 0x3FF;
+    adcsra &= ~(1 << ADSC);
+  }
+  return &adcsra;
+}
+
+//CLOCK
+unsigned long long host_time_us = 0;
+
+static unsigned long long timer_ticks(unsigned long long us){
+  return us * (HOST_F_CPU / 1000000UL) / HOST_TIMER_PRESCALER;
+}
+
+//Timer 0 runs at whatever its CS0 bits select
+static unsigned long timer0_prescaler(void){
+  static const unsigned long prescaler[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+  return prescaler[TCCR0B & 0x07];
+}
+
+static unsigned long long timer0_ticks(unsigned long long us){
+  unsigned long p = timer0_prescaler();
+  return p ? us * (HOST_F_CPU / 1000000UL) / p : 0;
+}
+
+//A conversion takes 13 ADC clocks at F_CPU / 128
+static unsigned long long adc_conversions(unsigned long long us){
+  return us * (HOST_F_CPU / 1000000UL) / (128UL * 13UL);
+}
+
+//Fires the ISRs due between two points in simulated time
+static void host_dispatch(unsigned long long from, unsigned long long to){
+  unsigned long long t0 = timer_ticks(from);
+  unsigned long long t1 = timer_ticks(to);
+  unsigned long long z0 = timer0_ticks(from);
+  unsigned long long z1 = timer0_ticks(to);
+
+  //Timer 0 is 8 bit, timer 1 is 16 bit; fire one ISR per wrap crossed
+  for (unsigned long long n = (z0 >> 8) + 1; n <= (z1 >> 8); n++){
+    TIMER0_OVF_vect();
+  }
+  for (unsigned long long n = (t0 >> 16) + 1; n <= (t1 >> 16); n++){
+    TIMER1_OVF_vect();
+  }
+
+  //Compare matches; the ISRs may move OCRnA on, so walk match by match
+  if (TIMSK0 & (1 << OCIE0A)){
+    unsigned long long z = z0;
+    for (;;){
+      unsigned long long gap = (uint8_t)(OCR0A - (uint8_t)z);
+      unsigned long long match = z + (gap ? gap : 256);
+      if (match > z1 || !(TIMSK0 & (1 << OCIE0A))){
+        break;
+      }
+      TCNT0 = match & 0xFF;
+      TCNT1 = timer_ticks(match * timer0_prescaler() / (HOST_F_CPU / 1000000UL)) & 0xFFFF;
+      TIMER0_COMPA_vect();
+      z = match;
+    }
+  }
+  if (TIMSK1 & (1 << OCIE1A)){
+    unsigned long long t = t0;
+    for (;;){
+      unsigned long long gap = (uint16_t)(OCR1A - (uint16_t)t);
+      unsigned long long match = t + (gap ? gap : 65536);
+      if (match > t1){
+        break;
+      }
+      TCNT1 = match & 0xFFFF;
+      TIMER1_COMPA_vect();
+      t = match;
+    }
+  }
+
+  //Free-running ADC with its interrupt enabled
+  uint8_t running = (1 << ADEN) | (1 << ADSC) | (1 << ADATE) | (1 << ADIE);
+  if ((adcsra & running) == running){
+    unsigned long long c0 = adc_conversions(from);
+    unsigned long long c1 = adc_conversions(to);
+    for (unsigned long long n = c0; n < c1; n++){
+      ADC = host_adc_input & 0x3FF;
+      ADC_vect();
+    }
+  }
+
+  TCNT0 = z1 & 0xFF;
+  TCNT1 = t1 & 0xFFFF;
+}
+
+static int host_dispatching = 0;
+static unsigned long long host_dispatched_us = 0;
+
+void host_advance_us(unsigned long us){
+  host_time_us += us;
+
+  //Time spent inside an ISR (the LCD pump's writes) only moves the clock on;
+  //the outermost call then fires whatever fell due meanwhile, as the AVR
+  //would once the ISR returned
+  if (host_dispatching){
+    return;
+  }
+  host_dispatching = 1;
+  while (host_dispatched_us < host_time_us){
+    unsigned long long from = host_dispatched_us;
+    host_dispatched_us = host_time_us;
+    host_dispatch(from, host_dispatched_us);
+  }
+  host_dispatching = 0;
+}
+
+uint16_t host_tcnt3(void){
+  return (uint16_t)bench_now_ns();
+}
+
+void host_set_pins(uint8_t b, uint8_t d, uint8_t f){
+  uint8_t changed_b = PINB ^ b;
+  uint8_t changed_d = PIND ^ d;
+  PINB = b;
+  PIND = d;
+  PINF = f;
+
+  //The game only asks for any-edge sensing, so any change fires
+  if ((changed_d & (1 << 0)) && (EIMSK & (1 << INT0))){
+    INT0_vect();
+  }
+  if ((changed_d & (1 << 1)) && (EIMSK & (1 << INT1))){
+    INT1_vect();
+  }
+  if ((changed_b & PCMSK0) && (PCICR & (1 << PCIE0))){
+    PCINT0_vect();
+  }
+}
+
+void host_delay_ms(double ms){
+  host_advance_us((unsigned long)(ms * 1000));
+}
+
+void host_delay_us(double us){
+  host_advance_us((unsigned long)us);
+}
+
+void host_sleep(void){
+  //Idle until something happens; one timer count is the finest step
+  host_advance_us(HOST_TIMER_PRESCALER * 1000000UL / HOST_F_CPU);
+}
+
+//PHASE TIMING
+unsigned long long bench_phase_ns[BENCH_PHASES];
+unsigned long host_phase_us[BENCH_PHASES];
+unsigned long long host_lcd_phase_bytes[BENCH_PHASES];
+unsigned long long bench_pair_tests;
+unsigned long long bench_pixel_tests;
+void (*bench_wheel)(uint8_t event);
+
+static int bench_phase = BENCH_IDLE;
+static unsigned long long bench_last_ns;
+
+unsigned long long bench_now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void bench_mark(int phase){
+  unsigned long long now = bench_now_ns();
+  bench_phase_ns[bench_phase] += now - bench_last_ns;
+  bench_phase = phase;
+  bench_last_ns = now;
+
+  if (host_phase_us[phase]){
+    host_advance_us(host_phase_us[phase]);
+  }
+}
+
+void bench_reset(void){
+  memset(bench_phase_ns, 0, sizeof(bench_phase_ns));
+  bench_phase = BENCH_IDLE;
+  bench_last_ns = bench_now_ns();
+}
+
+//LCD
+unsigned char host_lcd[LCD_X * (LCD_Y / 8)];
+unsigned long long host_lcd_bytes = 0;
+unsigned long host_lcd_byte_ns = 0;
+
+static int lcd_cursor = 0;
+static unsigned long lcd_spi_ns = 0;
+
+void lcd_init(unsigned char contrast){
+  (void)contrast;
+  lcd_clear();
+}
+
+void lcd_write(unsigned char dc, unsigned char data){
+  if (host_lcd_byte_ns){
+    lcd_spi_ns += host_lcd_byte_ns;
+    if (lcd_spi_ns >= 1000){
+      host_advance_us(lcd_spi_ns / 1000);
+      lcd_spi_ns %= 1000;
+    }
+  }
+
+  if (dc == LCD_D){
+    host_lcd[lcd_cursor] = data;
+    lcd_cursor = (lcd_cursor + 1) % (LCD_X * (LCD_Y / 8));
+    host_lcd_bytes++;
+    host_lcd_phase_bytes[bench_phase]++;
+  }
+}
+
+void lcd_clear(void){
+  memset(host_lcd, 0, sizeof(host_lcd));
+  lcd_cursor = 0;
+}
+
+void lcd_position(unsigned char x, unsigned char y){
+  lcd_cursor = (y * LCD_X + x) % (LCD_X * (LCD_Y / 8));
+}
+
+//GRAPHICS
+unsigned char screen_buffer[LCD_BUFFER_SIZE];
+
+void show_screen(void){
+  lcd_position(0, 0);
+  for (int i = 0; i < LCD_BUFFER_SIZE; i++){
+    lcd_write(LCD_D, screen_buffer[i]);
+  }
+}
+
+void clear_screen(void){
+  memset(screen_buffer, 0, sizeof(screen_buffer));
+}
+
+void draw_pixel(unsigned char x, unsigned char y, unsigned char value){
+  if (x >= LCD_X || y >= LCD_Y){
+    return;
+  }
+
+  unsigned char bank = y / 8;
+  unsigned char bit = 1 << (y % 8);
+
+  if (value){
+    screen_buffer[bank * LCD_X + x] |= bit;
+  }
+  else {
+    screen_buffer[bank * LCD_X + x] &= ~bit;
+  }
+}
+
+void draw_line(int x1, int y1, int x2, int y2){
+  int dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+  int dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+  int err = dx + dy;
+
+  for (;;){
+    draw_pixel(x1, y1, 1);
+    if (x1 == x2 && y1 == y2) break;
+    int e2 = 2 * err;
+    if (e2 >= dy){ err += dy; x1 += sx; }
+    if (e2 <= dx){ err += dx; y1 += sy; }
+  }
+}
+
+//The real library draws from a 5x7 ASCII font. The glyph shapes don't matter
+//on the host, only the per-pixel cost, so columns are derived from the code.
+static unsigned char glyph_column(char character, int col){
+  unsigned char c = (unsigned char)character;
+  if (c == ' '){
+    return 0;
+  }
+  return (unsigned char)((c * 37 + col * 11) | 0x41) & 0x7F;
+}
+
+void draw_char(unsigned char x, unsigned char y, char character){
+  for (int col = 0; col < 5; col++){
+    unsigned char bits = glyph_column(character, col);
+    for (int row = 0; row < 8; row++){
+      draw_pixel(x + col, y + row, (bits >> row) & 1);
+    }
+  }
+}
+
+void draw_string(unsigned char x, unsigned char y, char* string){
+  for (int i = 0; string[i] != '\0'; i++, x += 5){
+    draw_char(x, y, string[i]);
+  }
+}
+
+//SPRITES
+void init_sprite(Sprite* sprite, double x, double y, unsigned char width, unsigned char height, unsigned char* image){
+  sprite->x = x;
+  sprite->y = y;
+  sprite->width = width;
+  sprite->height = height;
+  sprite->bitmap = image;
+  sprite->is_visible = true;
+}
+
+void draw_sprite(Sprite* sprite){
+  if (!sprite->is_visible){
+    return;
+  }
+
+  int x = (int)round(sprite->x);
+  int y = (int)round(sprite->y);
+  int byte_width = (sprite->width + 7) / 8;
+
+  for (int row = 0; row < sprite->height; row++){
+    for (int col = 0; col < sprite->width; col++){
+      unsigned char byte = sprite->bitmap[row * byte_width + col / 8];
+      if ((byte >> (7 - col % 8)) & 1){
+        int px = x + col, py = y + row;
+        if (px >= 0 && py >= 0){
+          draw_pixel(px, py, 1);
+        }
+      }
+    }
+  }
+}
+
+//USB SERIAL
+unsigned long long host_usb_bytes = 0;
+int host_usb_echo = 0;
+FILE* host_usb_capture = NULL;
+
+#define HOST_KEY_QUEUE 64
+
+static int key_queue[HOST_KEY_QUEUE];
+static int key_head = 0, key_tail = 0;
+
+void host_serial_key(int key){
+  int next = (key_head + 1) % HOST_KEY_QUEUE;
+  if (next != key_tail){
+    key_queue[key_head] = key;
+    key_head = next;
+  }
+}
+
+void host_serial_clear(void){
+  key_head = key_tail = 0;
+}
+
+void usb_init(void){
+}
+
+uint8_t usb_configured(void){
+  return 1;
+}
+
+int16_t usb_serial_getchar(void){
+  if (key_head == key_tail){
+    return -1;
+  }
+  int key = key_queue[key_tail];
+  key_tail = (key_tail + 1) % HOST_KEY_QUEUE;
+  return key;
+}
+
+uint8_t usb_serial_available(void){
+  return (key_head - key_tail + HOST_KEY_QUEUE) % HOST_KEY_QUEUE;
+}
+
+void usb_serial_flush_input(void){
+  host_serial_clear();
+}
+
+int8_t usb_serial_putchar(uint8_t c){
+  host_usb_bytes++;
+  if (host_usb_echo){
+    putchar(c);
+  }
+  if (host_usb_capture){
+    fputc(c, host_usb_capture);
+  }
+  return 0;
+}
+
+int8_t usb_serial_putchar_nowait(uint8_t c){
+  return usb_serial_putchar(c);
+}
+
+int8_t usb_serial_write(const uint8_t* buffer, uint16_t size){
+  for (uint16_t i = 0; i < size; i++){
+    usb_serial_putchar(buffer[i]);
+  }
+  return 0;
+}
+
+void usb_serial_flush_output(void){
+}
+
+uint8_t usb_serial_get_control(void){
+  return USB_SERIAL_DTR | USB_SERIAL_RTS;
+}
@@ -0,0 +1,88 @@
+#ifndef HOST_H
+#define HOST_H
+
+//Host harness for running The-Horde.c on a desktop machine. The stand-in
+//headers in this directory replace the Teensy libraries; this header is the
+//driver-facing side: simulated time, scripted inputs and phase timing.
+
+#include <stdint.h>
+#include <stdio.h>
+#include "lcd.h"
+
+//Simulated clock (8 MHz CPU, timer 1 on the /1024 prescaler; timer 0 follows
+//its own prescaler bits)
+#define HOST_F_CPU 8000000UL
+#define HOST_TIMER_PRESCALER 1024UL
+
+extern unsigned long long host_time_us;
+
+void host_advance_us(unsigned long us);
+void host_sleep(void);
+
+//Scripted inputs. host_set_pins() also raises the pin-change interrupts the
+//game has enabled; writing PINB/PIND/PINF directly does not.
+extern uint16_t host_adc_input;
+
+void host_set_pins(uint8_t b, uint8_t d, uint8_t f);
+
+void host_serial_key(int key);
+void host_serial_clear(void);
+
+//Output accounting
+extern unsigned char host_lcd[LCD_X * (LCD_Y / 8)];
+extern unsigned long long host_lcd_bytes;
+
+//Simulated time each byte sent to the LCD takes; 0 (the default) makes the
+//LCD free, as it was before the cost was modelled
+extern unsigned long host_lcd_byte_ns;
+extern unsigned long long host_usb_bytes;
+extern int host_usb_echo;
+extern FILE* host_usb_capture; //Also receives every USB byte, if set
+
+//Interrupt vectors implemented by the game
+void TIMER0_OVF_vect(void);
+void TIMER0_COMPA_vect(void);
+void TIMER1_OVF_vect(void);
+void TIMER1_COMPA_vect(void);
+void ADC_vect(void);
+void INT0_vect(void);
+void INT1_vect(void);
+void PCINT0_vect(void);
+
+//Phase timing. The game marks the start of each phase of process(); the
+//wall-clock time until the next mark is charged to that phase.
+enum bench_phase {
+  BENCH_IDLE,
+  BENCH_MOVEMENT,
+  BENCH_COLLISION,
+  BENCH_RENDER,
+  BENCH_TELEMETRY,
+  BENCH_PHASES
+};
+
+extern unsigned long long bench_phase_ns[BENCH_PHASES];
+
+//Simulated CPU time charged as each phase starts (0 by default), and LCD
+//bytes written while each phase was running
+extern unsigned long host_phase_us[BENCH_PHASES];
+extern unsigned long long host_lcd_phase_bytes[BENCH_PHASES];
+
+void bench_mark(int phase);
+void bench_reset(void);
+unsigned long long bench_now_ns(void);
+
+#define BENCH_MARK(phase) bench_mark(phase)
+
+//Event counters, bumped by BENCH_COUNT(name) in the game
+extern unsigned long long bench_pair_tests;
+extern unsigned long long bench_pixel_tests;
+
+#define BENCH_COUNT(counter) (bench_##counter++)
+
+//Timer wheel test: while set, wheel_fire() hands every due event to this
+//instead of the game's handlers
+extern void (*bench_wheel)(uint8_t event);
+
+#define BENCH_WHEEL(event) (bench_wheel ? (bench_wheel(event), true) : false)
+
+#endif
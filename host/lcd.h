@@ -0,0 +1,24 @@
+#ifndef HOST_LCD_H
+#define HOST_LCD_H
+
+//Host stand-in for the PCD8544 driver. Bytes written in data mode land in
+//host_lcd[] and are counted, which models the SPI traffic of a real flush.
+
+#include <stdint.h>
+
+#define LCD_X 84
+#define LCD_Y 48
+
+#define LCD_C 0
+#define LCD_D 1
+
+#define LCD_DEFAULT_CONTRAST 0x3F
+#define LCD_LOW_CONTRAST 0x2F
+#define LCD_HIGH_CONTRAST 0x4F
+
+void lcd_init(unsigned char contrast);
+void lcd_write(unsigned char dc, unsigned char data);
+void lcd_clear(void);
+void lcd_position(unsigned char x, unsigned char y);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef HOST_SPRITE_H
+#define HOST_SPRITE_H
+
+#include <stdbool.h>
+
+typedef struct Sprite {
+  double x, y;
+  double dx, dy;
+  unsigned char width, height;
+  bool is_visible;
+  unsigned char* bitmap;
+} Sprite;
+
+void init_sprite(Sprite* sprite, double x, double y, unsigned char width, unsigned char height, unsigned char* image);
+void draw_sprite(Sprite* sprite);
+
+#endif
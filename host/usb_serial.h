@@ -0,0 +1,26 @@
+#ifndef HOST_USB_SERIAL_H
+#define HOST_USB_SERIAL_H
+
+//Host stand-in for the Teensy USB serial stack. Received bytes come from the
+//host driver's key queue; transmitted bytes are counted and optionally echoed.
+
+#include <stdint.h>
+
+void usb_init(void);
+uint8_t usb_configured(void);
+
+int16_t usb_serial_getchar(void);
+uint8_t usb_serial_available(void);
+void usb_serial_flush_input(void);
+
+int8_t usb_serial_putchar(uint8_t c);
+int8_t usb_serial_putchar_nowait(uint8_t c);
+int8_t usb_serial_write(const uint8_t* buffer, uint16_t size);
+void usb_serial_flush_output(void);
+
+uint8_t usb_serial_get_control(void);
+
+#define USB_SERIAL_DTR 0x01
+#define USB_SERIAL_RTS 0x02
+
+#endif
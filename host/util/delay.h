@@ -0,0 +1,13 @@
+#ifndef HOST_UTIL_DELAY_H
+#define HOST_UTIL_DELAY_H
+
+//Host stand-in for <util/delay.h>. Delays advance the simulated clock
+//(firing any timer interrupts that fall due) instead of sleeping.
+
+void host_delay_ms(double ms);
+void host_delay_us(double us);
+
+#define _delay_ms(ms) host_delay_ms(ms)
+#define _delay_us(us) host_delay_us(us)
+
+#endif